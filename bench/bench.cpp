@@ -0,0 +1,353 @@
+// gs2png-bench - Throughput of addressing, deswizzle, dump loading and PNG encoding
+#include "gsdump.h"
+#include "gsswizzle.h"
+#include "pngwriter.h"
+#include "threadpool.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+static constexpr u32 VRAM_SIZE = 4 * 1024 * 1024;
+static constexpr u32 VRAM_METADATA_SIZE = 425;
+
+struct BenchOptions
+{
+    double min_time = 0.5;      // Seconds each measurement repeats for
+    const char* filter = nullptr;
+    int threads = 0;
+};
+
+struct Pattern
+{
+    const char* name;
+    std::vector<u8> vram;
+};
+
+// Keeps results alive so the compiler cannot drop the measured work
+static volatile u32 g_sink;
+
+static void PrintUsage(const char* prog)
+{
+    printf("Usage: %s [options]\n", prog);
+    printf("\n");
+    printf("Options:\n");
+    printf("  --min-time <seconds>    Time spent repeating each measurement (default: 0.5)\n");
+    printf("  --filter <text>         Only run benchmarks whose name contains text\n");
+    printf("  -j, --threads <count>   Worker threads for the pooled runs (0 = all cores, default: 0)\n");
+    printf("  -h, --help              Show this help message\n");
+    printf("\n");
+    printf("Results are written as CSV: benchmark,pattern,param,iterations,seconds,mb_per_s,ns_per_pixel\n");
+    printf("MB/s counts the bytes each iteration reads from VRAM (or from the image, for encoding).\n");
+}
+
+static double Now()
+{
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Run func until min_time has passed (at least twice, the first run warming up)
+// and print one CSV row. bytes and pixels are per iteration.
+static void Measure(const BenchOptions& options, const char* name, const char* pattern, const std::string& param,
+    double bytes, double pixels, const std::function<void()>& func)
+{
+    if (options.filter && !strstr(name, options.filter))
+        return;
+
+    func();
+
+    int iterations = 0;
+    const double start = Now();
+    double elapsed = 0.0;
+    do
+    {
+        func();
+        iterations++;
+        elapsed = Now() - start;
+    } while (elapsed < options.min_time);
+
+    const double per_iteration = elapsed / iterations;
+    printf("%s,%s,%s,%d,%.9f,%.2f,%.3f\n", name, pattern, param.c_str(), iterations, per_iteration,
+        bytes / per_iteration / (1024.0 * 1024.0), per_iteration * 1e9 / pixels);
+    fflush(stdout);
+}
+
+static std::vector<Pattern> MakePatterns()
+{
+    std::vector<Pattern> patterns(3);
+
+    patterns[0].name = "zeros";
+    patterns[0].vram.assign(VRAM_SIZE, 0);
+
+    patterns[1].name = "noise";
+    patterns[1].vram.resize(VRAM_SIZE);
+    u32 state = 0x12345678;
+    for (u32 i = 0; i < VRAM_SIZE; i++)
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        patterns[1].vram[i] = static_cast<u8>(state);
+    }
+
+    // Smooth in screen space at 1024 wide, like most framebuffers
+    patterns[2].name = "gradient";
+    patterns[2].vram.resize(VRAM_SIZE);
+    u32* words = reinterpret_cast<u32*>(patterns[2].vram.data());
+    for (u32 y = 0; y < 1024; y++)
+    {
+        for (u32 x = 0; x < 1024; x++)
+        {
+            const u32 color = (x >> 2) | ((y >> 2) << 8) | (((x + y) >> 3) << 16) | 0x80000000;
+            words[PixelAddress32(x, y, 0, 16)] = color;
+        }
+    }
+
+    return patterns;
+}
+
+// A minimal dump around vram: fake CRC, header size, header, state (metadata + VRAM), registers
+static std::vector<u8> MakeDump(const std::vector<u8>& vram)
+{
+    GSDumpHeader header = {};
+    header.state_size = VRAM_METADATA_SIZE + VRAM_SIZE;
+
+    const u32 fake_crc = 0xFFFFFFFF;
+    const u32 header_size = sizeof(header);
+
+    const size_t vram_offset = 8 + sizeof(header) + VRAM_METADATA_SIZE;
+    std::vector<u8> dump(vram_offset + VRAM_SIZE + 8192, 0);
+    memcpy(dump.data(), &fake_crc, 4);
+    memcpy(dump.data() + 4, &header_size, 4);
+    memcpy(dump.data() + 8, &header, sizeof(header));
+    memcpy(dump.data() + vram_offset, vram.data(), VRAM_SIZE);
+    return dump;
+}
+
+static bool WriteTempDump(const std::vector<u8>& dump, std::string* path)
+{
+    char name[] = "/tmp/gs2png-bench-XXXXXX";
+    int fd = mkstemp(name);
+    if (fd < 0)
+        return false;
+
+    bool result = write(fd, dump.data(), dump.size()) == static_cast<ssize_t>(dump.size());
+    close(fd);
+    *path = name;
+    return result;
+}
+
+static void BenchAddressing(const BenchOptions& options, const Pattern& pattern)
+{
+    const int width = 1024;
+    const int height = 1024;
+    const double pixels = static_cast<double>(width) * height;
+
+    // Addressing does not touch VRAM, so it has no pattern
+    Measure(options, "PixelAddress32", "-", "1024", pixels * 4, pixels, [&]()
+    {
+        u32 sum = 0;
+        for (int y = 0; y < height; y++)
+            for (int x = 0; x < width; x++)
+                sum += PixelAddress32(x, y, 0, width / 64);
+        g_sink = sum;
+    });
+
+    Measure(options, "ReadPixel32", pattern.name, "1024", pixels * 4, pixels, [&]()
+    {
+        u32 sum = 0;
+        for (int y = 0; y < height; y++)
+            for (int x = 0; x < width; x++)
+                sum += ReadPixel32(pattern.vram.data(), x, y, 0, width / 64);
+        g_sink = sum;
+    });
+
+    // Row runs, as image transfers use them
+    static const u32 psms[] = { PSMCT32, PSMCT16, PSMT8, PSMT4 };
+    std::vector<u32> row(width);
+    for (u32 psm : psms)
+    {
+        const double bytes = pixels * GetPsmBitsPerPixel(psm) / 8;
+        Measure(options, "PixelAddress", "-", GetPsmName(psm), bytes, pixels, [&]()
+        {
+            u32 sum = 0;
+            for (int y = 0; y < height; y++)
+                for (int x = 0; x < width; x++)
+                    sum += PixelAddress(x, y, 0, width / 64, psm);
+            g_sink = sum;
+        });
+
+        Measure(options, "ReadPixels", pattern.name, GetPsmName(psm), bytes, pixels, [&]()
+        {
+            u32 sum = 0;
+            for (int y = 0; y < height; y++)
+            {
+                ReadPixels(pattern.vram.data(), 0, y, width, 0, width / 64, psm, row.data());
+                sum += row[y & (width - 1)];
+            }
+            g_sink = sum;
+        });
+    }
+}
+
+static void BenchDeswizzle(const BenchOptions& options, const Pattern& pattern, ThreadPool& pool)
+{
+    static const int widths[] = { 64, 256, 512, 640, 1024, 2048 };
+    std::vector<u8> image(VRAM_SIZE);
+
+    for (int width : widths)
+    {
+        const int height = VRAM_SIZE / 4 / width;
+        const double pixels = static_cast<double>(width) * height;
+        const std::string param = std::to_string(width);
+
+        Measure(options, "DeswizzleImage32", pattern.name, param, VRAM_SIZE, pixels, [&]()
+        {
+            DeswizzleImage32(pattern.vram.data(), image.data(), width, height, width / 64, false);
+        });
+
+        Measure(options, "DeswizzleImage32_pool", pattern.name, param, VRAM_SIZE, pixels, [&]()
+        {
+            DeswizzleImage32(pattern.vram.data(), image.data(), width, height, width / 64, false, pool);
+        });
+    }
+
+    // The generic path for the other formats, at the default width
+    static const u32 psms[] = { PSMCT16, PSMT8, PSMT4 };
+    for (u32 psm : psms)
+    {
+        const int width = 1024;
+        const int height = static_cast<int>(static_cast<u64>(VRAM_SIZE) * 8 / GetPsmBitsPerPixel(psm) / width);
+        const double pixels = static_cast<double>(width) * height;
+        image.resize(static_cast<size_t>(width) * height * 4);
+
+        Measure(options, "DeswizzleRect", pattern.name, GetPsmName(psm), VRAM_SIZE, pixels, [&]()
+        {
+            DeswizzleRect(pattern.vram.data(), image.data(), 0, 0, width, height, 0, width / 64, psm, false, nullptr);
+        });
+    }
+}
+
+static void BenchLoad(const BenchOptions& options, const Pattern& pattern)
+{
+    const std::vector<u8> dump = MakeDump(pattern.vram);
+    const double pixels = VRAM_SIZE / 4;
+    GSDumpFile file;
+
+    Measure(options, "GSDumpFile::Open", pattern.name, "memory", VRAM_SIZE, pixels, [&]()
+    {
+        file.Open(dump.data(), dump.size());
+        g_sink = file.GetVRAM()[VRAM_SIZE - 1];
+    });
+
+    std::string path;
+    if (!WriteTempDump(dump, &path))
+    {
+        fprintf(stderr, "Error: Could not write a temporary dump\n");
+        return;
+    }
+
+    // The page cache holds the file after the first run, so this is the in-memory cost
+    Measure(options, "GSDumpFile::Open", pattern.name, "mmap", VRAM_SIZE, pixels, [&]()
+    {
+        file.Open(path.c_str(), GSDumpLoadMode::Map);
+        g_sink = file.GetVRAM()[VRAM_SIZE - 1];
+    });
+
+    Measure(options, "GSDumpFile::Open", pattern.name, "read", VRAM_SIZE, pixels, [&]()
+    {
+        file.Open(path.c_str(), GSDumpLoadMode::Read);
+        g_sink = file.GetVRAM()[VRAM_SIZE - 1];
+    });
+
+    file.Close();
+    unlink(path.c_str());
+}
+
+static void BenchEncode(const BenchOptions& options, const Pattern& pattern, ThreadPool& pool)
+{
+    static const PngSpeed speeds[] = { PngSpeed::Fast, PngSpeed::Balanced, PngSpeed::Max };
+    static const char* const speed_names[] = { "fast", "balanced", "max" };
+
+    const int width = 1024;
+    const int height = 1024;
+    const double pixels = static_cast<double>(width) * height;
+    std::vector<u8> image(VRAM_SIZE);
+    DeswizzleImage32(pattern.vram.data(), image.data(), width, height, width / 64, false);
+
+    PngEncoder encoder;
+    std::vector<u8> png;
+    for (int i = 0; i < 3; i++)
+    {
+        Measure(options, "EncodePNG", pattern.name, speed_names[i], VRAM_SIZE, pixels, [&]()
+        {
+            encoder.Encode(image.data(), width, height, width * 4, speeds[i], nullptr, &png);
+        });
+
+        if (speeds[i] != PngSpeed::Max)
+        {
+            Measure(options, "EncodePNG_pool", pattern.name, speed_names[i], VRAM_SIZE, pixels, [&]()
+            {
+                encoder.Encode(image.data(), width, height, width * 4, speeds[i], &pool, &png);
+            });
+        }
+
+        // Ratio of the last encode, as a comment so the CSV stays parseable
+        if (!png.empty())
+            printf("# EncodePNG %s %s: %zu bytes (%.1f%%)\n", pattern.name, speed_names[i], png.size(), png.size() * 100.0 / VRAM_SIZE);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    BenchOptions options;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--min-time") == 0 && i + 1 < argc)
+        {
+            options.min_time = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+        {
+            options.filter = argv[++i];
+        }
+        else if ((strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "--threads") == 0) && i + 1 < argc)
+        {
+            options.threads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0)
+        {
+            PrintUsage(argv[0]);
+            return 0;
+        }
+        else
+        {
+            fprintf(stderr, "Error: Unknown option '%s'\n", argv[i]);
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    ThreadPool pool(options.threads);
+    const std::vector<Pattern> patterns = MakePatterns();
+
+    printf("# kernel=%s threads=%d\n", GetDeswizzleKernelName(), pool.GetThreadCount());
+    printf("benchmark,pattern,param,iterations,seconds,mb_per_s,ns_per_pixel\n");
+
+    BenchAddressing(options, patterns[1]);
+    for (const Pattern& pattern : patterns)
+    {
+        BenchDeswizzle(options, pattern, pool);
+        BenchLoad(options, pattern);
+        BenchEncode(options, pattern, pool);
+    }
+
+    return 0;
+}
@@ -0,0 +1,33 @@
+// Batch conversion of many dumps in one process
+#pragma once
+
+#include "convert.h"
+#include "stats.h"
+#include <string>
+#include <vector>
+
+// <output_dir>/<input file name without .gs, .gs.xz or .gs.zst>.png, or the extension of format
+std::string GetOutputPath(const char* output_dir, const std::string& input, ImageFormat format = ImageFormat::Png);
+
+// A dump in dir that sorts before name and so claims the same output path
+// first (x.gs for x.gs.xz), or empty if name's output is its own
+std::string FindEarlierSiblingDump(const std::string& dir, const std::string& name);
+
+// Sorted file names of the dumps directly in dir_path; false if it cannot be read
+bool ListDumps(const char* dir_path, std::vector<std::string>* names);
+
+// Load input and save it to output, in the format its extension names when
+// options ask for ImageFormat::Auto. Failures are reported on stderr; either
+// way the result goes to stats. Reusing one converter keeps its buffers.
+bool ConvertDump(Converter& converter, const std::string& input, const std::string& output, const ConvertOptions& options,
+    StatsReport& stats);
+
+// Convert every dump named by source into output_dir.
+// source is a directory (all *.gs files), a glob pattern, or a manifest file
+// listing one "<input.gs> [output.png]" pair per line. With ImageFormat::Auto,
+// manifest outputs are written in the format their extension names.
+// Each job and the batch totals go to stats when it is enabled. A job whose
+// output an earlier job already writes (x.gs and x.gs.xz, or one name matched
+// in two directories) is reported and counted as failed instead of overwriting it.
+// Returns the number of failed jobs, or -1 if source could not be read.
+int RunBatch(const char* source, const char* output_dir, const ConvertOptions& options, int thread_count, StatsReport& stats);
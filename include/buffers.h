@@ -0,0 +1,60 @@
+// Allocation of the large VRAM and image buffers (--huge-pages) and NUMA placement (--numa)
+#pragma once
+
+#include "types.h"
+#include <cstddef>
+#include <new>
+
+enum class HugePages
+{
+    Off,            // Ordinary pages
+    Transparent,    // 2MB-aligned mappings advised with MADV_HUGEPAGE
+    Explicit,       // MAP_HUGETLB from the reserved pool, else Transparent
+};
+
+// Look up a mode by name: off, thp or explicit
+bool FindHugePages(const char* name, HugePages* mode);
+
+// Applies to buffers allocated after the call, so set it before starting work
+void SetHugePages(HugePages mode);
+
+// size bytes, uninitialised. Buffers of 2MB and up are mapped on their own,
+// 2MB aligned, and only get physical pages when first written: Linux then
+// places them on the NUMA node of the writing thread. Null on failure.
+void* AllocateBuffer(size_t size);
+
+// Free a buffer from AllocateBuffer; size must be the size it was allocated with
+void FreeBuffer(void* data, size_t size);
+
+// AllocateBuffer for standard containers, e.g. std::vector<u8, BufferAllocator<u8>>
+template <typename T>
+struct BufferAllocator
+{
+    typedef T value_type;
+
+    BufferAllocator() = default;
+    template <typename U>
+    BufferAllocator(const BufferAllocator<U>&) {}
+
+    T* allocate(size_t count)
+    {
+        void* data = AllocateBuffer(count * sizeof(T));
+        if (!data)
+            throw std::bad_alloc();
+        return static_cast<T*>(data);
+    }
+
+    void deallocate(T* data, size_t count) { FreeBuffer(data, count * sizeof(T)); }
+
+    template <typename U>
+    bool operator==(const BufferAllocator<U>&) const { return true; }
+    template <typename U>
+    bool operator!=(const BufferAllocator<U>&) const { return false; }
+};
+
+// NUMA nodes that have CPUs (1 without NUMA or when sysfs cannot be read)
+int GetNumaNodeCount();
+
+// Keep the calling thread on the CPUs of the node-th NUMA node, so that the
+// buffers it allocates and fills afterwards are local to it
+bool BindThreadToNumaNode(int node);
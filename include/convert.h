@@ -0,0 +1,144 @@
+// VRAM to PNG conversion shared by single-file and batch modes
+#pragma once
+
+#include "buffers.h"
+#include "gsdump.h"
+#include "imagewriter.h"
+#include "layout.h"
+#include "pngwriter.h"
+#include "stats.h"
+#include "types.h"
+#include <cstddef>
+#include <vector>
+
+class ThreadPool;
+
+struct ConvertOptions
+{
+    int vram_width = 1024;
+    bool detect_width = false;  // Guess vram_width for each dump (layout.h)
+    u32 psm = 0;                // Pixel storage format (GSPsm), PSMCT32 by default
+    u32 bp = 0;                 // Base pointer in 256-byte blocks
+    bool detect_region = false; // Guess bp and the rect for each dump
+    bool has_rect = false;      // Extract rect_* instead of the whole 4MB
+    int rect_x = 0;
+    int rect_y = 0;
+    int rect_width = 0;
+    int rect_height = 0;
+    bool has_clut = false;      // Look up index formats in the CLUT at cbp
+    u32 cbp = 0;
+    u32 cpsm = 0;               // CLUT format: PSMCT32, PSMCT16 or PSMCT16S
+    u32 csm = 0;                // 0 = CSM1, 1 = CSM2
+    bool expand_clut = false;   // Write RGBA instead of a palette PNG
+    bool force_alpha = false;
+    GSDumpLoadMode load_mode = GSDumpLoadMode::Map;
+    PngSpeed png_speed = PngSpeed::Balanced;
+    ImageFormat format = ImageFormat::Auto;     // Written by Write, Stream and Save
+    TileOrder tile_order = TileOrder::Linear;   // Pixel order of Raw output
+    const char* cache_dir = nullptr;    // Reuse PNGs of identical VRAM from here (pngcache.h)
+    bool numa_local = false;    // Spread batch and watch workers over NUMA nodes, one each (buffers.h)
+};
+
+// Hash of the options that change the output pixels (not how the dump is
+// loaded or how hard the PNG is compressed)
+u64 HashConvertOptions(const ConvertOptions& options);
+
+// One conversion context; the VRAM and image buffers are reused between jobs
+class Converter
+{
+public:
+    bool Load(const char* input_file, const ConvertOptions& options);
+
+    // Load a dump already in memory (raw, xz or zstd); data must outlive the converter's use of it
+    bool Load(const void* data, size_t size);
+
+    void Deswizzle(const ConvertOptions& options, ThreadPool* pool = nullptr);
+
+    // Deswizzle another 4MB VRAM image (such as a replayed frame) instead of the loaded dump
+    void Deswizzle(const u8* vram, const ConvertOptions& options, ThreadPool* pool = nullptr);
+
+    // Deswizzle the loaded dump into caller storage, rows packed (GetImageBufferSize bytes).
+    // Fails if out_size is too small for the image, which with detected layouts can be
+    // as large as GetImageBufferSize of the whole of VRAM at 64 pixels wide.
+    bool Deswizzle(const ConvertOptions& options, u8* out, size_t out_size, ThreadPool* pool = nullptr);
+
+    // Write the last deswizzled image as options.format (PNG for Auto)
+    bool Write(const char* output_file, const ConvertOptions& options, ThreadPool* pool = nullptr);
+
+    // Deswizzle + Write the loaded dump, unless options.cache_dir holds the
+    // PNG of an identical VRAM image and options, which is linked instead
+    // (the cache is not used for "-", standard output).
+    // Without a pool of several threads (and for any speed but Max) this goes
+    // through Stream instead, with the same output.
+    bool Save(const char* output_file, const ConvertOptions& options, ThreadPool* pool = nullptr);
+
+    // Deswizzle, filter and deflate one page row of the buffer at a time
+    // straight into output_file (PngStreamWriter), never holding the whole
+    // image: memory stays at one page row of pixels plus the encoder's strip.
+    // Always writes PNG. Leaves GetImage alone.
+    bool Stream(const u8* vram, const char* output_file, const ConvertOptions& options);
+
+    // Encode the last deswizzled image (or the caller's copy of it) as PNG into out
+    bool Encode(const ConvertOptions& options, std::vector<u8>* out, ThreadPool* pool = nullptr);
+    bool Encode(const u8* image, const ConvertOptions& options, std::vector<u8>* out, ThreadPool* pool = nullptr);
+
+    // Load + Save on the calling thread
+    bool Convert(const char* input_file, const char* output_file, const ConvertOptions& options);
+
+    const GSDumpFile& GetDump() const { return m_dump; }
+    int GetWidth() const { return m_width; }
+    int GetHeight() const { return m_height; }
+
+    // Non-zero when the image holds CLUT indices rather than RGBA
+    int GetPaletteSize() const { return m_paletteSize; }
+    const u32* GetPalette() const { return m_palette; }
+
+    // The last image deswizzled into the converter's own buffer, rows packed
+    const u8* GetImage() const { return m_image.data(); }
+
+    // Options of the last deswizzle, with any detected width, bp and rect filled in
+    const ConvertOptions& GetLayout() const { return m_layout; }
+
+    // Stage timings and counters since the last Load (or ResetStats)
+    const ConvertStats& GetStats() const { return m_stats; }
+    void ResetStats() { m_stats = ConvertStats(); }
+
+    // Output dimensions for the given options
+    static void GetImageSize(const ConvertOptions& options, int* width, int* height);
+
+    // Bytes needed for the deswizzled image: one per pixel for palette PNG output, else
+    // four, for whole tiles when Raw output is tiled
+    static size_t GetImageBufferSize(const ConvertOptions& options);
+
+private:
+    // options, or a copy with the layout guessed from vram when asked to
+    const ConvertOptions& ResolveLayout(const u8* vram, const ConvertOptions& options);
+
+    // Set up the size and CLUT of the next image; returns the bytes it needs
+    size_t PrepareImage(const u8* vram, const ConvertOptions& options);
+    void DeswizzleImage(const u8* vram, const ConvertOptions& options, u8* out, ThreadPool* pool);
+    void DeswizzleTiles(const u8* vram, const ConvertOptions& options, u8* out, ThreadPool* pool);
+    void DeswizzleTile(const u8* vram, const ConvertOptions& options, int tile_x, int tile_y, u8* out, u8* scratch) const;
+    void BuildMortonOrder();
+    bool WriteImage(const char* output_file, ImageFormat format);
+    void DeswizzleRows(const u8* vram, const ConvertOptions& options, int first_row, int row_count, u8* out, ThreadPool* pool);
+
+    GSDumpFile m_dump;
+    std::vector<u8, BufferAllocator<u8>> m_image;
+    std::vector<u8> m_png;
+    std::vector<u8> m_band;     // Page row being streamed, or one tile being reordered per thread
+    std::vector<u32> m_mortonOrder;     // Z order of a tile as y << 16 | x
+    PngEncoder m_encoder;
+    PngStreamWriter m_stream;
+    LayoutDetector m_detector;
+    ConvertOptions m_layout;
+    ConvertStats m_stats;
+    u32 m_palette[256] = {};
+    int m_paletteSize = 0;
+    bool m_hasClut = false;     // m_palette is valid
+    int m_width = 0;
+    int m_height = 0;
+    TileOrder m_tileOrder = TileOrder::Linear;  // Of the image being deswizzled
+    int m_tileWidth = 0;
+    int m_tileHeight = 0;
+};
@@ -0,0 +1,29 @@
+// Raw DEFLATE encoding for the PNG writer, and zlib decoding for the PNG reader
+#pragma once
+
+#include "types.h"
+#include <cstddef>
+#include <vector>
+
+// Compress data[start, end) as non-final fixed-Huffman blocks and append a
+// sync flush (an empty stored block), so the output ends on a byte boundary
+// and chunks can be concatenated into one stream. Up to 32KB before start is
+// used as the match window, exactly as if the stream had been compressed in
+// one go. quality is the stb compression level (higher searches longer chains).
+void DeflateCompressChunk(const u8* data, size_t start, size_t end, int quality, std::vector<u8>* out);
+
+// Same contract as DeflateCompressChunk, but only emits runs that repeat the
+// previous byte or the previous pixel. Several times faster, for speed-first output.
+void DeflateCompressChunkRLE(const u8* data, size_t start, size_t end, int pixel_size, std::vector<u8>* out);
+
+// Append the final (empty) block that terminates a stream of chunks
+void DeflateFinish(std::vector<u8>* out);
+
+// Decompress a zlib stream (as held by PNG IDAT chunks), appending to out.
+// Fails on a malformed or truncated stream or a checksum mismatch.
+bool ZlibDecompress(const u8* data, size_t size, std::vector<u8>* out);
+
+u32 Adler32(const u8* data, size_t len, u32 adler = 1);
+
+// Adler-32 of A+B given the checksums of A and B and the length of B
+u32 Adler32Combine(u32 adler1, u32 adler2, size_t len2);
@@ -0,0 +1,84 @@
+// Sequential reader for raw and compressed GS dumps
+#pragma once
+
+#include "types.h"
+#include <cstddef>
+#include <vector>
+
+enum class DumpCompression
+{
+    None,
+    Xz,
+    Zstd,
+};
+
+// Length of the dump extension (".gs", ".gs.xz" or ".gs.zst") that name ends with, or 0
+size_t GetDumpExtensionLength(const char* name);
+
+// The index-th dump extension, in sorted order, or null past the last
+const char* GetDumpExtension(int index);
+
+// Reads a dump front to back. xz and zstd files are recognised by their magic
+// bytes and decoded on demand through fixed-size buffers, so only as much of
+// the file as is read (or skipped) is ever decompressed.
+class DumpStream
+{
+public:
+    DumpStream();
+    ~DumpStream();
+
+    // "-" reads standard input, which can be a pipe: nothing is ever seeked
+    bool Open(const char* filename);
+
+    // Read a dump already in memory; data must outlive the stream
+    bool Open(const void* data, size_t size);
+
+    void Close();
+
+    // Returns the bytes read; fewer than size only at the end of the stream or on error
+    size_t Read(void* data, size_t size);
+
+    // Returns false if the stream ends first (raw files seek, so only later reads
+    // notice; pipes are read through)
+    bool Skip(u64 size);
+
+    bool HasError() const { return m_error; }
+
+    // Bytes taken from the file or memory source so far (compressed bytes for xz/zstd)
+    u64 GetBytesRead() const { return m_bytesRead; }
+    DumpCompression GetCompression() const { return m_compression; }
+
+    // Compression used by the file, from its first bytes
+    static DumpCompression DetectCompression(const u8* data, size_t size);
+
+    // Whether this build can decode the given format
+    static bool IsSupported(DumpCompression compression);
+    static const char* GetCompressionName(DumpCompression compression);
+
+private:
+    size_t Decode(u8* data, size_t size);
+    size_t DecodeXz(u8* data, size_t size);
+    size_t DecodeZstd(u8* data, size_t size);
+    bool FillInput();
+    bool OpenPipe(int fd);
+    bool InitDecoder();
+
+    int m_fd;
+    const u8* m_memory;         // Memory source instead of m_fd
+    size_t m_memorySize;
+    size_t m_memoryPos;
+    DumpCompression m_compression;
+    void* m_decoder;            // lzma_stream or ZSTD_DStream
+    bool m_inputDone;           // Compressed file fully read
+    bool m_streamEnd;           // Decoder reported the end of the data
+    bool m_error;
+    u64 m_bytesRead;
+
+    std::vector<u8> m_inputBuffer;
+    const u8* m_input;          // Compressed bytes (m_inputBuffer or memory)
+    size_t m_inputPos;
+    size_t m_inputSize;
+    std::vector<u8> m_output;   // Decoded bytes not yet returned
+    size_t m_outputPos;
+    size_t m_outputEnd;
+};
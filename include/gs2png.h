@@ -0,0 +1,25 @@
+// libgs2png public API
+#pragma once
+
+// Buffer-in/buffer-out use, with every buffer kept by the Converter between calls:
+//
+//     Converter converter;
+//     converter.Load(dump_data, dump_size);
+//     std::vector<u8> image(Converter::GetImageBufferSize(options));
+//     converter.Deswizzle(options, image.data(), image.size());
+//     converter.Encode(image.data(), options, &png);
+//
+// Compressed dumps set up a fresh decoder on each Load. The other direction
+// (PNG back into a dump's VRAM) is PatchDump, or ReadPNG plus SwizzleImage.
+// Link with libgs2png.a or libgs2png.so (plus -pthread and -llzma/-lzstd when built with them).
+
+#include "convert.h"
+#include "dumpstream.h"
+#include "gsdump.h"
+#include "gsswizzle.h"
+#include "png2gs.h"
+#include "pngreader.h"
+#include "pngwriter.h"
+#include "stats.h"
+#include "threadpool.h"
+#include "types.h"
@@ -1,6 +1,7 @@
 // GS Dump file format parsing
 #pragma once
 
+#include "dumpstream.h"
 #include "types.h"
 #include <cstdio>
 #include <cstring>
@@ -20,21 +21,61 @@ struct GSDumpHeader
 };
 #pragma pack(pop)
 
+enum class GSDumpLoadMode
+{
+    Map,    // Map the file and point straight into it (zero copy)
+    Read,   // Read VRAM with one large read into a buffer reused across opens
+    Patch,  // Map VRAM shared and writable so changes go straight to the file
+};
+
+// xz and zstd compressed dumps are detected by their magic bytes and always
+// decoded into the read buffer, stopping at the end of VRAM, as is a dump
+// read from standard input ("-"). Only complete raw dump files can be patched.
+
 class GSDumpFile
 {
 public:
     GSDumpFile();
     ~GSDumpFile();
 
-    bool Open(const char* filename);
+    bool Open(const char* filename, GSDumpLoadMode mode = GSDumpLoadMode::Map);
+
+    // Use a dump already in memory. VRAM of a complete raw dump is used in
+    // place (data must stay valid until Close); compressed or truncated dumps
+    // are decoded into the read buffer.
+    bool Open(const void* data, size_t size);
     void Close();
 
+    // Only byte aligned: mapped and in-place VRAM starts 425 bytes into the
+    // freeze data, wherever the file puts it. The gsswizzle functions read and
+    // write it through unaligned-safe loads and stores.
     const u8* GetVRAM() const { return m_vram; }
+
+    // VRAM of a dump opened with GSDumpLoadMode::Patch, null otherwise. Writes
+    // land in the file; the rest of it is never touched.
+    u8* GetMutableVRAM() { return m_writable ? const_cast<u8*>(m_vram) : nullptr; }
+
     bool IsValid() const { return m_vram != nullptr; }
+    bool IsMapped() const { return m_map != nullptr; }
+
+    // Bytes of the dump read by the last Open: compressed input for xz/zstd,
+    // otherwise the VRAM present in the file (mapped files are paged in later)
+    u64 GetBytesRead() const { return m_bytesRead; }
 
 private:
     static constexpr u32 VRAM_SIZE = 4 * 1024 * 1024;  // 4MB
     static constexpr u32 VRAM_METADATA_SIZE = 425;
 
-    u8* m_vram;
+    bool ReadHeader(int fd, u64* vram_offset);
+    bool MapVRAM(int fd, u64 file_size, u64 vram_offset, bool writable);
+    bool ReadVRAM(int fd, u64 vram_offset);
+    bool DecodeVRAM();
+
+    const u8* m_vram;
+    u8* m_buffer;       // Read mode storage, kept until destruction
+    void* m_map;        // Map mode region
+    size_t m_mapSize;
+    bool m_writable;    // Patch mode mapping
+    u64 m_bytesRead;
+    DumpStream m_stream;    // xz/zstd decoding, buffers kept across opens
 };
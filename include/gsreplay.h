@@ -0,0 +1,87 @@
+// GS dump packet stream replay
+#pragma once
+
+#include "buffers.h"
+#include "dumpstream.h"
+#include "types.h"
+#include <cstddef>
+#include <vector>
+
+// Streams through a dump (raw, xz or zstd) once: loads the VRAM saved with the initial state,
+// then applies the image transfers (HOST->LOCAL and LOCAL->LOCAL) found in the
+// GIF packets that follow, stopping at each vsync. Draws are not rendered.
+class GSReplayer
+{
+public:
+    GSReplayer();
+    ~GSReplayer();
+
+    bool Open(const char* filename);
+    void Close();
+
+    // Apply packets up to and including the next vsync. Returns false at the
+    // end of the stream or on a malformed packet (see HasError).
+    bool NextFrame();
+
+    const u8* GetVRAM() const { return m_vram.data(); }
+    int GetFrame() const { return m_frame; }     // Vsyncs replayed so far
+    bool HasError() const { return m_error; }
+    u64 GetBytesRead() const { return m_stream.GetBytesRead(); }   // From the dump file so far
+
+private:
+    static constexpr u32 VRAM_SIZE = 4 * 1024 * 1024;
+    static constexpr u32 VRAM_METADATA_SIZE = 425;
+    static constexpr u32 REGISTERS_SIZE = 8192;
+    static constexpr int PATH_COUNT = 3;   // PATH1, PATH2, PATH3
+
+    // GIF tag state of one path; tags and loops may span packets
+    struct GIFPath
+    {
+        u32 nloop = 0;      // Loops left in the current tag
+        u32 nreg = 0;
+        u32 reg = 0;        // Register descriptor index within the loop
+        u32 flg = 0;
+        u64 regs = 0;
+        u8 partial[16];     // Start of a qword cut by the end of a packet
+        u32 partial_size = 0;
+    };
+
+    // Active HOST->LOCAL transfer
+    struct Transfer
+    {
+        bool active = false;
+        u32 bp = 0;
+        u32 bw = 0;
+        u32 psm = 0;
+        int x = 0;          // Destination origin
+        int y = 0;
+        int width = 0;
+        int height = 0;
+        int cx = 0;         // Next pixel, relative to the origin
+        int cy = 0;
+        u8 partial[4];      // Bytes of a pixel cut by the end of a qword
+        u32 partial_size = 0;
+    };
+
+    bool Read(void* data, size_t size);
+    bool Skip(u64 size);
+
+    void ProcessGIF(GIFPath& path, const u8* data, size_t size);
+    void ProcessQword(GIFPath& path, const u8* qword);
+    void WriteRegister(u32 addr, u64 value);
+    void HostToLocal(const u8* data, size_t size);
+    void LocalToLocal();
+
+    DumpStream m_stream;
+
+    std::vector<u8, BufferAllocator<u8>> m_vram;
+    std::vector<u8> m_packet;
+    std::vector<u32> m_row;
+    GIFPath m_paths[PATH_COUNT];
+    Transfer m_transfer;
+    u64 m_bitbltbuf;
+    u64 m_trxpos;
+    u64 m_trxreg;
+    int m_frame;
+    bool m_error;
+};
@@ -2,5 +2,105 @@
 
 #include "types.h"
 
+class ThreadPool;
+
+// GS pixel storage formats (PSM register values)
+enum GSPsm : u32
+{
+    PSMCT32  = 0x00,
+    PSMCT24  = 0x01,
+    PSMCT16  = 0x02,
+    PSMCT16S = 0x0A,
+    PSMT8    = 0x13,
+    PSMT4    = 0x14,
+    PSMT8H   = 0x1B,
+    PSMT4HL  = 0x24,
+    PSMT4HH  = 0x2C,
+    PSMZ32   = 0x30,
+    PSMZ24   = 0x31,
+    PSMZ16   = 0x32,
+    PSMZ16S  = 0x3A,
+};
+
+bool IsValidPsm(u32 psm);
+const char* GetPsmName(u32 psm);
+
+// Look up a format by name ("PSMT8" or "t8", any case) or register value
+bool FindPsm(const char* name, u32* psm);
+
+// Bits each pixel occupies in VRAM (32 for PSMT8H/4HL/4HH, which share 32-bit words)
+int GetPsmBitsPerPixel(u32 psm);
+
+// Page width in pixels (64, or 128 for PSMT8/PSMT4); buffer widths must be a multiple
+int GetPsmPageWidth(u32 psm);
+
+// Page height in pixels (32, 64 or 128); a page holds 8KB of the format
+int GetPsmPageHeight(u32 psm);
+
+// PSMT8, PSMT4, PSMT8H, PSMT4HL and PSMT4HH hold CLUT indices
+bool IsIndexedPsm(u32 psm);
+
+// Word address of pixel (x, y) in a PSMCT32 buffer at block pointer bp (in
+// 256-byte blocks) with bw 64-pixel pages per row. Wraps at the end of VRAM.
 u32 PixelAddress32(int x, int y, u32 bp, u32 bw);
 u32 ReadPixel32(const u8* vram, int x, int y, u32 bp, u32 bw);
+
+// Address of pixel (x, y) for any format, in units of the format's storage
+// size (words, halfwords, bytes or nibbles). bw is in 64-pixel units.
+u32 PixelAddress(int x, int y, u32 bp, u32 bw, u32 psm);
+
+// Read or write the raw values (as sent by a GS image transfer: 32-bit color,
+// 24-bit color, 16-bit color or an index) of count pixels on row y starting
+// at x. Coordinates wrap at 2048. Returns false for an unknown psm.
+bool ReadPixels(const u8* vram, int x, int y, int count, u32 bp, u32 bw, u32 psm, u32* values);
+bool WritePixels(u8* vram, int x, int y, int count, u32 bp, u32 bw, u32 psm, const u32* values);
+
+// Deswizzle a width x height PSMCT32 buffer into RGBA rows (width must be a multiple of 64).
+// Whole 8x8 blocks go through the fastest kernel the CPU supports.
+void DeswizzleImage32(const u8* vram, u8* out, int width, int height, u32 bw, bool force_alpha);
+
+// Same as above, with page rows (32 scanlines each) spread across the pool
+void DeswizzleImage32(const u8* vram, u8* out, int width, int height, u32 bw, bool force_alpha, ThreadPool& pool);
+
+// Deswizzle the width x height rect at (x, y) of the buffer at bp into tightly packed RGBA rows.
+// Only blocks overlapping the rect are read.
+void DeswizzleRect32(const u8* vram, u8* out, int x, int y, int width, int height, u32 bp, u32 bw, bool force_alpha);
+void DeswizzleRect32(const u8* vram, u8* out, int x, int y, int width, int height, u32 bp, u32 bw, bool force_alpha, ThreadPool& pool);
+
+// Same for any format. 16-bit and 24-bit alpha expand to 0x80 (opaque on the GS)
+// and 0x00; index formats look up palette (RGBA, from ReadClut) or come out as
+// gray levels when it is null. Returns false for an unknown psm.
+bool DeswizzleRect(const u8* vram, u8* out, int x, int y, int width, int height, u32 bp, u32 bw, u32 psm, bool force_alpha, const u32* palette);
+bool DeswizzleRect(const u8* vram, u8* out, int x, int y, int width, int height, u32 bp, u32 bw, u32 psm, bool force_alpha, const u32* palette, ThreadPool& pool);
+
+// Copy the raw CLUT indices of an index format, one byte per pixel.
+// Returns false if psm is not an index format.
+bool ExtractIndexRect(const u8* vram, u8* out, int x, int y, int width, int height, u32 bp, u32 bw, u32 psm);
+bool ExtractIndexRect(const u8* vram, u8* out, int x, int y, int width, int height, u32 bp, u32 bw, u32 psm, ThreadPool& pool);
+
+// The inverse of DeswizzleRect: write the width x height RGBA image into the
+// rect at (x, y) of a color format buffer. 16-bit color keeps the top 5 bits
+// of each channel and sets A for alpha 0x80 and up; 24-bit formats leave the
+// top byte of each word alone. Returns false for index formats or an unknown psm.
+bool SwizzleRect(u8* vram, const u8* rgba, int x, int y, int width, int height, u32 bp, u32 bw, u32 psm);
+
+// Write one CLUT index byte per pixel into an index format buffer. Only the
+// bits of the format change, so PSMT8H/4HL/4HH keep the color they share a
+// word with. Returns false if psm is not an index format.
+bool SwizzleIndexRect(u8* vram, const u8* indices, int x, int y, int width, int height, u32 bp, u32 bw, u32 psm);
+
+// CLUT size of an index format: 256 for 8-bit indices, 16 for 4-bit, 0 otherwise
+int GetClutEntryCount(u32 psm);
+
+// Read the CLUT used by psm from the buffer at cbp into palette as RGBA
+// (GetClutEntryCount(psm) entries). cpsm is PSMCT32, PSMCT16 or PSMCT16S; csm
+// is the TEX0 CSM field: 0 for CSM1 (16x16 or 8x2 layout), 1 for CSM2 (one row),
+// which like the GS only accepts PSMCT16. The TEXCLUT offsets (CBW, COU, COV)
+// are not modelled: a CSM2 CLUT is read from the first row at cbp.
+bool ReadClut(const u8* vram, u32 cbp, u32 cpsm, u32 csm, u32 psm, bool force_alpha, u32* palette);
+
+// The inverse of ReadClut: store GetClutEntryCount(psm) RGBA entries at cbp
+bool WriteClut(u8* vram, u32 cbp, u32 cpsm, u32 csm, u32 psm, const u32* palette);
+
+// Name of the block kernel selected at runtime ("avx2", "sse2" or "scalar")
+const char* GetDeswizzleKernelName();
@@ -0,0 +1,27 @@
+// 64-bit content hashing (XXH64) for change detection and caches
+#pragma once
+
+#include "types.h"
+#include <cstddef>
+
+// Incremental XXH64; feeding the data in any number of pieces gives the same hash
+class Hash64
+{
+public:
+    explicit Hash64(u64 seed = 0);
+
+    void Update(const void* data, size_t size);
+    u64 Finish() const;
+
+private:
+    u64 m_acc[4];
+    u8 m_buffer[32];    // Tail not yet consumed as a whole stripe
+    size_t m_buffered;
+    u64 m_total;
+    u64 m_seed;
+};
+
+u64 HashBytes(const void* data, size_t size, u64 seed = 0);
+
+// Hash of a file's contents; false if it cannot be read
+bool HashFile(const char* filename, u64* hash);
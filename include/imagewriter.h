@@ -0,0 +1,64 @@
+// Output formats other than PNG, for tools that only want the pixels (--format)
+#pragma once
+
+#include "types.h"
+#include <cstddef>
+#include <vector>
+
+enum class ImageFormat
+{
+    Auto,   // From the output file extension, else PNG
+    Png,
+    Qoi,    // Quite OK Image format: lossless, a single fast pass
+    Raw,    // Bare RGBA rows (.rgba) with a <file>.json sidecar giving the size
+    Pam,    // Netpbm P7, RGB_ALPHA
+    Dds,    // Uncompressed 32-bit RGBA DirectDraw Surface
+};
+
+// Pixel order of Raw output (--tile-order). Tiles are GS pages of the
+// format (64x32 for 32-bit color), counted from the image origin, one row of
+// tiles after another; edge tiles are padded out with zeros.
+enum class TileOrder
+{
+    Linear,     // Scanlines of the whole image
+    Pages,      // Tile after tile, each in scanlines
+    Morton,     // Tile after tile, each in Z order (x bit first)
+};
+
+// Look up a tile order by name: linear, pages or morton
+bool FindTileOrder(const char* name, TileOrder* order);
+const char* GetTileOrderName(TileOrder order);
+
+// Look up a format by name: png, qoi, rgba (or raw), pam or dds
+bool FindImageFormat(const char* name, ImageFormat* format);
+
+// The format named by the extension of path, or PNG
+ImageFormat GetImageFormatFromPath(const char* path);
+
+// format itself, or for Auto the format of path
+ImageFormat ResolveImageFormat(ImageFormat format, const char* path);
+
+// ".png", ".qoi", ".rgba", ".pam" or ".dds" (Auto writes PNG)
+const char* GetImageFormatExtension(ImageFormat format);
+
+// "PNG", "QOI", "raw RGBA", "PAM" or "DDS", for messages
+const char* GetImageFormatName(ImageFormat format);
+
+// PNG or Auto; the other formats only hold RGBA, so palettes are expanded for them
+inline bool IsPngFormat(ImageFormat format)
+{
+    return format == ImageFormat::Auto || format == ImageFormat::Png;
+}
+
+// The bytes that precede width x height packed RGBA pixels in a Raw, Pam or
+// Dds file (none for Raw)
+void GetImageHeader(ImageFormat format, int width, int height, std::vector<u8>* out);
+
+// Encode an 8-bit RGBA image as QOI
+bool EncodeQOI(const u8* rgba, int width, int height, int stride, std::vector<u8>* out);
+
+// Write header then data to filename with a single writev
+bool WriteImageFile(const char* filename, const u8* header, size_t header_size, const u8* data, size_t size);
+
+// <filename>.json describing a Raw image, and its tiles unless order is Linear
+bool WriteRawSidecar(const char* filename, int width, int height, TileOrder order, int tile_width, int tile_height);
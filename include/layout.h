@@ -0,0 +1,45 @@
+// Buffer width and region detection (-w auto, --bp auto)
+#pragma once
+
+#include "types.h"
+#include <cstddef>
+#include <vector>
+
+struct ConvertOptions;
+
+// Guesses where an image lies in VRAM from how well the edges of its 8KB
+// pages line up: with the right width, the bottom row of each page continues
+// into the top row of the page one buffer row further on, and rows of pages
+// break off where the buffer wraps. Only page edges are deswizzled, once,
+// whatever the number of candidate widths. Buffers are kept between calls.
+class LayoutDetector
+{
+public:
+    // Set options->vram_width when detect_width is set, and bp plus a rect
+    // covering the largest run of connected page rows when detect_region is.
+    // Guesses that are not clear leave their options as they were.
+    // Returns true if everything asked for was found.
+    bool Detect(const u8* vram, ConvertOptions* options);
+
+private:
+    void ReadPageEdges(const u8* vram, u32 psm);
+    u32 GetRowDiff(int page, int pages_per_row) const;
+    bool IsVerticalMatch(int page, int pages_per_row) const;
+    int DetectPagesPerRow() const;
+    bool DetectRegion(int pages_per_row, ConvertOptions* options) const;
+
+    int m_pageWidth = 0;
+    int m_pageHeight = 0;
+    int m_maxPagesPerRow = 0;
+    size_t m_rowBytes = 0;
+    size_t m_columnBytes = 0;
+    std::vector<u8> m_top;          // First row of every page
+    std::vector<u8> m_bottom;       // Last row of every page
+    std::vector<u8> m_left;         // First column of every page, top to bottom
+    std::vector<u8> m_right;        // Last column of every page
+    std::vector<u8> m_detail;       // Page has a top or bottom row that is not one color
+    std::vector<u8> m_leftDetail;   // Same for the first column
+    std::vector<u8> m_rightDetail;  // And the last
+    std::vector<u32> m_rowDiffs;    // GetRowDiff for every page and candidate width
+    std::vector<u32> m_meanDiffs;   // Per page, averaged over the candidate widths
+};
@@ -0,0 +1,20 @@
+// PNG to VRAM conversion for texture replacement (--png2gs)
+#pragma once
+
+#include "convert.h"
+#include "pngreader.h"
+#include "stats.h"
+#include "types.h"
+
+// Swizzle image into a 4MB VRAM image: into the buffer at options.bp with
+// options.vram_width, at the rect origin (the rect size must match the image).
+// Color formats take the RGBA pixels. Index formats take the indices of a
+// palette PNG or the levels of a grayscale one; with options.has_clut the
+// palette is written to the CLUT at cbp as well. Returns false with a message
+// on stderr if the image does not fit the options.
+bool SwizzleImage(u8* vram, const PngImage& image, const ConvertOptions& options);
+
+// Read png_file and patch it into the VRAM of dump_file in place; the rest of
+// the file is left as it is. Load time covers reading the PNG and mapping the
+// dump, deswizzle time the swizzle and write time flushing the dump.
+bool PatchDump(const char* png_file, const char* dump_file, const ConvertOptions& options, ConvertStats* stats);
@@ -0,0 +1,16 @@
+// Cache of written PNGs keyed by VRAM contents and conversion options (--cache)
+#pragma once
+
+#include "convert.h"
+#include "types.h"
+
+// Key for the PNG that options would produce from this 4MB VRAM image
+u64 GetPngCacheKey(const u8* vram, const ConvertOptions& options);
+
+// Hard-link the PNG cached under key to output_file, or copy it when the two
+// are on different file systems. Returns false on a miss.
+bool FetchCachedPng(const char* cache_dir, u64 key, const char* output_file);
+
+// Add a freshly written output_file to the cache under key (linked like
+// FetchCachedPng). An existing entry for the key is kept.
+void StoreCachedPng(const char* cache_dir, u64 key, const char* output_file);
@@ -0,0 +1,23 @@
+// PNG decoder for writing images back into VRAM
+#pragma once
+
+#include "types.h"
+#include <cstddef>
+#include <vector>
+
+struct PngImage
+{
+    int width = 0;
+    int height = 0;
+    std::vector<u8> rgba;       // Every image, expanded to 8-bit RGBA
+    std::vector<u8> indices;    // Palette images only: one index byte per pixel
+    u32 palette[256] = {};      // RGBA, with tRNS alpha applied
+    int palette_size = 0;       // Zero unless the PNG has a palette
+};
+
+// Decode any non-interlaced PNG: grayscale, RGB, palette, gray + alpha or RGBA,
+// at every legal bit depth (16-bit samples keep their high byte). tRNS is
+// applied to the palette or as a color key. Returns false with a message on
+// stderr for unsupported or corrupt files.
+bool DecodePNG(const u8* data, size_t size, PngImage* image);
+bool ReadPNG(const char* filename, PngImage* image);
@@ -0,0 +1,117 @@
+// Multithreaded PNG encoder
+#pragma once
+
+#include "types.h"
+#include <cstddef>
+#include <cstdio>
+#include <vector>
+
+class ThreadPool;
+
+enum class PngSpeed
+{
+    Fast,       // Single filter, run-length-only deflate
+    Balanced,   // Per-row filter choice, hash-chain deflate
+    Max,        // stbi_write_png, single-threaded
+};
+
+// Encode an 8-bit RGBA image. Except for Max, rows are filtered and deflated
+// in independent horizontal strips (in parallel when a pool is given) and
+// stitched into a single zlib stream, one IDAT chunk per strip. Output does
+// not depend on the thread count.
+bool EncodePNG(const u8* rgba, int width, int height, int stride, PngSpeed speed, ThreadPool* pool, std::vector<u8>* out);
+
+bool WritePNG(const char* filename, const u8* rgba, int width, int height, int stride, PngSpeed speed, ThreadPool* pool);
+
+// Encode one index byte per pixel as a palette PNG (color type 3) with PLTE and,
+// when any entry is not opaque, tRNS. palette holds RGBA entries; 16-entry
+// palettes are written at 4 bits per pixel, 256-entry ones at 8. Max uses the
+// Balanced encoder, since stb cannot write palette images.
+bool EncodeIndexedPNG(const u8* indices, int width, int height, int stride, const u32* palette, int palette_size, PngSpeed speed, ThreadPool* pool, std::vector<u8>* out);
+
+bool WriteIndexedPNG(const char* filename, const u8* indices, int width, int height, int stride, const u32* palette, int palette_size, PngSpeed speed, ThreadPool* pool);
+
+// Write an encoded PNG to disk
+bool WritePNGFile(const char* filename, const std::vector<u8>& png);
+
+// fopen(filename, "wb"), except that a hard-linked file (see pngcache.h) is
+// replaced rather than written through, and "-" writes to standard output
+FILE* CreateOutputFile(const char* filename);
+
+// Whether filename is "-", standard output to CreateOutputFile
+inline bool IsStdoutPath(const char* filename)
+{
+    return filename[0] == '-' && filename[1] == '\0';
+}
+
+// Same encoders with their working buffers kept between calls. Once warmed up
+// on the largest image size, encoding without a pool allocates nothing (out
+// keeps its capacity too); PngSpeed::Max still goes through stb, which does.
+class PngEncoder
+{
+public:
+    bool Encode(const u8* rgba, int width, int height, int stride, PngSpeed speed, ThreadPool* pool, std::vector<u8>* out);
+    bool EncodeIndexed(const u8* indices, int width, int height, int stride, const u32* palette, int palette_size, PngSpeed speed, ThreadPool* pool, std::vector<u8>* out);
+
+private:
+    void EncodeIDAT(const u8* rows, int row_bytes, int height, int stride, int pixel_bytes, int fixed_filter, PngSpeed speed, ThreadPool* pool, std::vector<u8>* out);
+
+    std::vector<u8> m_filtered;                 // Filter byte + filtered row, all rows
+    std::vector<u8> m_packed;                   // 4-bit indices
+    std::vector<u8> m_zeroRow;
+    std::vector<u8> m_scratch;                  // Filter trial row per strip
+    std::vector<std::vector<u8>> m_chunks;      // IDAT chunk per strip
+    std::vector<u32> m_adlers;
+};
+
+// Writes a PNG straight to a file a few rows at a time, without the whole
+// image in memory: rows are filtered as they arrive and every full strip is
+// deflated and written out as an IDAT chunk. It holds one strip of filtered
+// rows (256KB) plus the 32KB match window, whatever the image size. The file
+// is identical to what PngEncoder writes for the same speed; PngSpeed::Max,
+// which needs stb and the whole image, is encoded as Balanced.
+class PngStreamWriter
+{
+public:
+    ~PngStreamWriter();
+
+    // Write the header of a width x height RGBA image or, with a 16 or 256
+    // entry palette (RGBA), of a palette image taking one index byte per pixel
+    bool Open(const char* filename, int width, int height, PngSpeed speed);
+    bool OpenIndexed(const char* filename, int width, int height, const u32* palette, int palette_size, PngSpeed speed);
+
+    // Add the next count rows, stride bytes apart
+    bool WriteRows(const u8* rows, int count, size_t stride);
+
+    // Flush the last strip and end the file; fails unless every row was written
+    bool Close();
+
+    // Bytes written to the file so far
+    u64 GetBytesWritten() const { return m_bytesWritten; }
+
+private:
+    bool Begin(const char* filename, int width, int height, int row_bytes, int pixel_bytes, int filter, PngSpeed speed);
+    bool WriteChunks(const std::vector<u8>& data);
+    bool FlushStrip();
+
+    FILE* m_fp = nullptr;
+    int m_width = 0;
+    int m_height = 0;
+    int m_rowsWritten = 0;
+    int m_rowBytes = 0;         // Bytes per PNG row, after packing 4-bit indices
+    int m_pixelBytes = 0;
+    int m_filter = -1;          // Fixed filter type, or -1 to pick one per row
+    int m_bitDepth = 8;
+    PngSpeed m_speed = PngSpeed::Balanced;
+    size_t m_stripRows = 0;
+    size_t m_stripStart = 0;    // Offset of the current strip in m_filtered, after the window
+    u32 m_adler = 1;
+    bool m_first = true;        // Next IDAT starts the zlib stream
+    bool m_ok = false;
+    u64 m_bytesWritten = 0;
+    std::vector<u8> m_filtered; // Match window, then the filtered rows of the current strip
+    std::vector<u8> m_prevRow;  // Previous row before filtering (zero above the first)
+    std::vector<u8> m_packed;   // Row of 4-bit indices
+    std::vector<u8> m_scratch;
+    std::vector<u8> m_chunk;
+};
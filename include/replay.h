@@ -0,0 +1,24 @@
+// Per-frame conversion of a replayed dump
+#pragma once
+
+#include "convert.h"
+#include "stats.h"
+#include <vector>
+
+// Inclusive range of frame numbers; frame 0 is the VRAM saved with the dump,
+// frame n the VRAM at the n-th vsync
+struct FrameRange
+{
+    int first;
+    int last;
+};
+
+// Parse "3", "0,5,10-20" style lists. Returns false on a malformed list.
+bool ParseFrameList(const char* text, std::vector<FrameRange>* ranges);
+
+// Replay input and write <output_dir>/<name>_<frame>.png (or the extension
+// of options.format) for every selected frame, or for every vsync when frames
+// is empty. Each written frame (its load time being the packets replayed
+// since the previous one) goes to stats.
+// Returns the number of failed frames, or -1 if the dump could not be replayed.
+int RunReplay(const char* input, const char* output_dir, const ConvertOptions& options, const std::vector<FrameRange>& frames, int thread_count, StatsReport& stats);
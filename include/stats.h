@@ -0,0 +1,80 @@
+// Per-stage timings and counters for conversions (--stats)
+#pragma once
+
+#include "types.h"
+#include <cstdio>
+#include <mutex>
+#include <string>
+
+enum class StatsFormat
+{
+    None,
+    Text,   // A few aligned lines per file
+    Json,   // One JSON object per line
+};
+
+// What one conversion (or, summed, a whole run) spent its time on
+struct ConvertStats
+{
+    double load_seconds = 0.0;      // Opening the dump (or replaying packets up to a frame)
+    double deswizzle_seconds = 0.0; // Includes mmap page faults, which happen on first access
+    double encode_seconds = 0.0;    // PNG filtering and compression
+    double write_seconds = 0.0;     // Writing the PNG file
+    u64 bytes_read = 0;             // From the dump
+    u64 pixels = 0;                 // Deswizzled
+    u64 png_bytes = 0;              // Compressed output
+    u64 cache_hits = 0;             // PNGs linked from the --cache directory instead
+
+    double GetTotalSeconds() const { return load_seconds + deswizzle_seconds + encode_seconds + write_seconds; }
+    void Add(const ConvertStats& other);
+};
+
+// Seconds on a monotonic clock
+double GetStatsTime();
+
+// Adds the time until it goes out of scope to *seconds
+class ScopedTimer
+{
+public:
+    explicit ScopedTimer(double* seconds)
+        : m_seconds(seconds)
+        , m_start(GetStatsTime())
+    {
+    }
+
+    ~ScopedTimer() { *m_seconds += GetStatsTime() - m_start; }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    double* m_seconds;
+    double m_start;
+};
+
+// Prints a record per conversion and the totals of a run. Safe to share between threads.
+class StatsReport
+{
+public:
+    StatsReport();
+    ~StatsReport();
+
+    // filename null writes to stderr, keeping stdout for progress messages
+    bool Open(StatsFormat format, const char* filename);
+    bool IsEnabled() const { return m_format != StatsFormat::None; }
+
+    // frame < 0 for plain conversions
+    void AddFile(const char* input, const char* output, int frame, bool ok, const ConvertStats& stats);
+
+    // Totals over every AddFile, with the wall-clock time of the run
+    void Finish(double wall_seconds);
+
+private:
+    StatsFormat m_format;
+    FILE* m_fp;
+    bool m_ownsFile;
+    std::mutex m_mutex;
+    ConvertStats m_total;
+    int m_files;
+    int m_failed;
+};
@@ -0,0 +1,24 @@
+// Conversion of one dump at many buffer widths (--width-sweep)
+#pragma once
+
+#include "convert.h"
+#include "stats.h"
+
+// Inclusive range of buffer widths in pixels
+struct WidthRange
+{
+    int first;
+    int last;
+};
+
+// Parse "64..2048" (or a single width). Returns false on a malformed range.
+bool ParseWidthRange(const char* text, WidthRange* range);
+
+// Load input once and write <output_dir>/<name>_w<width>.png (or the extension
+// of options.format) for every width in widths that is a multiple of the
+// format's page width, deswizzling the widths in parallel from the same VRAM.
+// With contact_sheet, a scaled-down corner of every result is also tiled into
+// <output_dir>/<name>_sheet.png, narrowest width first. Each width goes to
+// stats; the first one carries the load.
+// Returns the number of failed widths, or -1 if the dump could not be loaded.
+int RunWidthSweep(const char* input, const char* output_dir, const ConvertOptions& options, const WidthRange& widths, bool contact_sheet, int thread_count, StatsReport& stats);
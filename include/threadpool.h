@@ -0,0 +1,98 @@
+// Fixed-size worker thread pool
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+public:
+    // threads <= 0 uses every hardware thread; 1 runs all work on the calling thread
+    explicit ThreadPool(int threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    int GetThreadCount() const { return m_threadCount; }
+
+    // Queue a task; runs inline when the pool has no workers
+    void Submit(std::function<void()> task);
+
+    // Run func(i) for every i in [0, count) and return when all are done.
+    // The calling thread takes part and only waits for helpers that have
+    // started, so this is safe to call from a pool task (even from every worker at once).
+    void ParallelFor(int count, const std::function<void(int)>& func);
+
+    static int GetHardwareThreadCount();
+
+private:
+    void WorkerLoop();
+
+    int m_threadCount;
+    std::vector<std::thread> m_workers;
+    std::queue<std::function<void()>> m_tasks;
+    std::mutex m_mutex;
+    std::condition_variable m_taskReady;
+    bool m_stop;
+};
+
+// Blocking FIFO with a fixed capacity, used to hand jobs to worker threads
+template <typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t capacity)
+        : m_capacity(capacity > 0 ? capacity : 1)
+        , m_closed(false)
+    {
+    }
+
+    // Blocks while the queue is full; returns false once the queue is closed
+    bool Push(T item)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_notFull.wait(lock, [this] { return m_closed || m_items.size() < m_capacity; });
+        if (m_closed)
+            return false;
+
+        m_items.push(std::move(item));
+        m_notEmpty.notify_one();
+        return true;
+    }
+
+    // Blocks while the queue is empty; returns false once it is closed and drained
+    bool Pop(T* item)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_notEmpty.wait(lock, [this] { return m_closed || !m_items.empty(); });
+        if (m_items.empty())
+            return false;
+
+        *item = std::move(m_items.front());
+        m_items.pop();
+        m_notFull.notify_one();
+        return true;
+    }
+
+    // No more items will be pushed; wakes every waiting thread
+    void Close()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closed = true;
+        m_notEmpty.notify_all();
+        m_notFull.notify_all();
+    }
+
+private:
+    size_t m_capacity;
+    std::queue<T> m_items;
+    std::mutex m_mutex;
+    std::condition_variable m_notFull;
+    std::condition_variable m_notEmpty;
+    bool m_closed;
+};
@@ -0,0 +1,15 @@
+// Watch-folder conversion daemon (--watch)
+#pragma once
+
+#include "convert.h"
+#include "stats.h"
+
+// Convert the dumps in watch_dir that are new or changed, then keep watching
+// the directory (inotify) and convert dumps as they are written or moved in,
+// until SIGINT or SIGTERM. Outputs are named as in batch mode.
+// Finished work is recorded in <output_dir>/.gs2png-index (name, size, mtime
+// and content hash) so a restart skips unchanged dumps; a dump rewritten with
+// the same contents only has its entry refreshed. Changing the conversion
+// options starts a fresh index.
+// Returns the number of failed conversions, or -1 if watch_dir cannot be watched.
+int RunWatch(const char* watch_dir, const char* output_dir, const ConvertOptions& options, int thread_count, StatsReport& stats);
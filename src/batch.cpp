@@ -0,0 +1,251 @@
+// Batch conversion implementation
+#include "batch.h"
+#include "dumpstream.h"
+#include "threadpool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <functional>
+#include <glob.h>
+#include <map>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <vector>
+
+struct BatchJob
+{
+    int index = 0;
+    std::string input;
+    std::string output;
+};
+
+typedef std::function<void(const std::string& input, const std::string& output)> BatchJobSink;
+
+std::string GetOutputPath(const char* output_dir, const std::string& input, ImageFormat format)
+{
+    size_t slash = input.find_last_of('/');
+    std::string name = slash == std::string::npos ? input : input.substr(slash + 1);
+    name.resize(name.size() - GetDumpExtensionLength(name.c_str()));
+
+    return std::string(output_dir) + "/" + name + GetImageFormatExtension(format);
+}
+
+std::string FindEarlierSiblingDump(const std::string& dir, const std::string& name)
+{
+    const std::string stem = name.substr(0, name.size() - GetDumpExtensionLength(name.c_str()));
+    for (int i = 0; const char* ext = GetDumpExtension(i); i++)
+    {
+        const std::string sibling = stem + ext;
+        if (sibling >= name)
+            break;
+
+        struct stat st;
+        if (stat((dir + "/" + sibling).c_str(), &st) == 0 && S_ISREG(st.st_mode))
+            return sibling;
+    }
+    return std::string();
+}
+
+bool ListDumps(const char* dir_path, std::vector<std::string>* names)
+{
+    DIR* dir = opendir(dir_path);
+    if (!dir)
+        return false;
+
+    names->clear();
+    while (dirent* entry = readdir(dir))
+    {
+        if (GetDumpExtensionLength(entry->d_name) != 0)
+            names->push_back(entry->d_name);
+    }
+    closedir(dir);
+
+    // Directory order is arbitrary; sort so runs are reproducible
+    std::sort(names->begin(), names->end());
+    return true;
+}
+
+bool ConvertDump(Converter& converter, const std::string& input, const std::string& output, const ConvertOptions& options,
+    StatsReport& stats)
+{
+    ConvertOptions job_options = options;
+    job_options.format = ResolveImageFormat(options.format, output.c_str());
+
+    if (!converter.Load(input.c_str(), job_options))
+    {
+        fprintf(stderr, "Error: Failed to open GS dump file: %s\n", input.c_str());
+        stats.AddFile(input.c_str(), output.c_str(), -1, false, converter.GetStats());
+        return false;
+    }
+
+    if (!converter.Save(output.c_str(), job_options))
+    {
+        fprintf(stderr, "Error: Failed to write output file: %s\n", output.c_str());
+        stats.AddFile(input.c_str(), output.c_str(), -1, false, converter.GetStats());
+        return false;
+    }
+
+    stats.AddFile(input.c_str(), output.c_str(), -1, true, converter.GetStats());
+    return true;
+}
+
+static bool EnumerateDirectory(const char* dir_path, const char* output_dir, ImageFormat format, const BatchJobSink& sink)
+{
+    std::vector<std::string> names;
+    if (!ListDumps(dir_path, &names))
+        return false;
+
+    for (const std::string& name : names)
+    {
+        std::string input = std::string(dir_path) + "/" + name;
+        sink(input, GetOutputPath(output_dir, input, format));
+    }
+    return true;
+}
+
+static bool EnumerateGlob(const char* pattern, const char* output_dir, ImageFormat format, const BatchJobSink& sink)
+{
+    // glob can allocate even when it fails, so every exit frees matches
+    glob_t matches;
+    int result = glob(pattern, 0, nullptr, &matches);
+    if (result != 0)
+    {
+        globfree(&matches);
+        return result == GLOB_NOMATCH;
+    }
+
+    for (size_t i = 0; i < matches.gl_pathc; i++)
+    {
+        std::string input = matches.gl_pathv[i];
+        sink(input, GetOutputPath(output_dir, input, format));
+    }
+
+    globfree(&matches);
+    return true;
+}
+
+// One "<input.gs> [output.png]" per line; blank lines and '#' comments are skipped
+static bool EnumerateManifest(const char* manifest_path, const char* output_dir, ImageFormat format, const BatchJobSink& sink)
+{
+    FILE* fp = fopen(manifest_path, "r");
+    if (!fp)
+        return false;
+
+    char* line = nullptr;
+    size_t capacity = 0;
+    while (getline(&line, &capacity, fp) != -1)
+    {
+        const char* whitespace = " \t\r\n";
+        char* input = line + strspn(line, whitespace);
+        if (*input == '\0' || *input == '#')
+            continue;
+
+        char* end = input + strcspn(input, whitespace);
+        char* output = end + strspn(end, whitespace);
+        output[strcspn(output, whitespace)] = '\0';
+        *end = '\0';
+
+        if (*output)
+            sink(input, output);
+        else
+            sink(input, GetOutputPath(output_dir, input, format));
+    }
+
+    free(line);
+    fclose(fp);
+    return true;
+}
+
+static void BatchWorker(int worker_index, BoundedQueue<BatchJob>& queue, const ConvertOptions& options, StatsReport& stats, std::atomic<int>& converted, std::atomic<int>& failures)
+{
+    // Bind before the converter exists, so all of its buffers land on this node
+    if (options.numa_local)
+        BindThreadToNumaNode(worker_index % GetNumaNodeCount());
+
+    Converter converter;
+
+    BatchJob job;
+    while (queue.Pop(&job))
+    {
+        if (!ConvertDump(converter, job.input, job.output, options, stats))
+        {
+            failures++;
+            continue;
+        }
+
+        printf("[%d] %s -> %s\n", job.index, job.input.c_str(), job.output.c_str());
+        converted++;
+    }
+}
+
+int RunBatch(const char* source, const char* output_dir, const ConvertOptions& options, int thread_count, StatsReport& stats)
+{
+    struct stat st;
+    const bool exists = stat(source, &st) == 0;
+    const bool is_glob = !exists && strpbrk(source, "*?[") != nullptr;
+    if (!exists && !is_glob)
+        return -1;
+
+    if (mkdir(output_dir, 0777) != 0 && errno != EEXIST)
+        return -1;
+
+    if (thread_count <= 0)
+        thread_count = ThreadPool::GetHardwareThreadCount();
+
+    const double start_time = GetStatsTime();
+
+    // A couple of jobs per worker keeps everyone busy without buffering the whole list
+    BoundedQueue<BatchJob> queue(thread_count * 2);
+    std::atomic<int> converted(0);
+    std::atomic<int> failures(0);
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < thread_count; i++)
+        workers.emplace_back(BatchWorker, i, std::ref(queue), std::cref(options), std::ref(stats), std::ref(converted), std::ref(failures));
+
+    // Enumeration order decides which input keeps a contested output
+    int job_count = 0;
+    std::map<std::string, std::string> output_inputs;
+    BatchJobSink sink = [&](const std::string& input, const std::string& output)
+    {
+        ++job_count;
+        auto claimed = output_inputs.emplace(output, input);
+        if (!claimed.second)
+        {
+            fprintf(stderr, "Error: %s would overwrite %s from %s; skipped\n", input.c_str(), output.c_str(),
+                claimed.first->second.c_str());
+            failures++;
+            return;
+        }
+
+        BatchJob job;
+        job.index = job_count;
+        job.input = input;
+        job.output = output;
+        queue.Push(std::move(job));
+    };
+
+    bool enumerated;
+    if (is_glob)
+        enumerated = EnumerateGlob(source, output_dir, options.format, sink);
+    else if (S_ISDIR(st.st_mode))
+        enumerated = EnumerateDirectory(source, output_dir, options.format, sink);
+    else
+        enumerated = EnumerateManifest(source, output_dir, options.format, sink);
+
+    queue.Close();
+    for (std::thread& worker : workers)
+        worker.join();
+
+    if (!enumerated)
+        return -1;
+
+    printf("Converted %d of %d dumps\n", converted.load(), job_count);
+    stats.Finish(GetStatsTime() - start_time);
+    return failures.load();
+}
@@ -0,0 +1,170 @@
+// Buffer allocation and NUMA placement implementation
+#include "buffers.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <sched.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <vector>
+
+static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+static std::atomic<HugePages> s_hugePages(HugePages::Off);
+
+bool FindHugePages(const char* name, HugePages* mode)
+{
+    if (strcasecmp(name, "off") == 0)
+        *mode = HugePages::Off;
+    else if (strcasecmp(name, "thp") == 0)
+        *mode = HugePages::Transparent;
+    else if (strcasecmp(name, "explicit") == 0)
+        *mode = HugePages::Explicit;
+    else
+        return false;
+    return true;
+}
+
+void SetHugePages(HugePages mode)
+{
+    s_hugePages = mode;
+}
+
+// Whether the buffer is mapped by itself depends only on its size, so FreeBuffer
+// can tell without a header (which would cost the alignment)
+static size_t GetMappingSize(size_t size)
+{
+    return (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+}
+
+void* AllocateBuffer(size_t size)
+{
+    if (size < HUGE_PAGE_SIZE)
+        return malloc(size);
+
+    const size_t map_size = GetMappingSize(size);
+    const HugePages mode = s_hugePages;
+    if (mode == HugePages::Explicit)
+    {
+        void* data = mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (data != MAP_FAILED)
+            return data;
+    }
+
+    // Map a huge page more than needed and trim both ends to a 2MB boundary
+    u8* base = static_cast<u8*>(mmap(nullptr, map_size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if (base == MAP_FAILED)
+        return nullptr;
+
+    u8* data = reinterpret_cast<u8*>((reinterpret_cast<uintptr_t>(base) + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1));
+    if (data > base)
+        munmap(base, data - base);
+    if (base + HUGE_PAGE_SIZE > data)
+        munmap(data + map_size, base + HUGE_PAGE_SIZE - data);
+
+    if (mode != HugePages::Off)
+        madvise(data, map_size, MADV_HUGEPAGE);
+    return data;
+}
+
+void FreeBuffer(void* data, size_t size)
+{
+    if (!data)
+        return;
+
+    if (size < HUGE_PAGE_SIZE)
+        free(data);
+    else
+        munmap(data, GetMappingSize(size));
+}
+
+// Parse a sysfs CPU list such as "0-15,32-47"
+static bool ParseCpuList(const char* text, cpu_set_t* cpus)
+{
+    CPU_ZERO(cpus);
+    bool any = false;
+    while (*text && *text != '\n')
+    {
+        char* end;
+        long first = strtol(text, &end, 10);
+        if (end == text)
+            return false;
+
+        long last = first;
+        if (*end == '-')
+        {
+            const char* p = end + 1;
+            last = strtol(p, &end, 10);
+            if (end == p)
+                return false;
+        }
+
+        for (long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++)
+        {
+            CPU_SET(cpu, cpus);
+            any = true;
+        }
+
+        text = *end == ',' ? end + 1 : end;
+    }
+    return any;
+}
+
+// CPUs of every node that has any, read once
+static const std::vector<cpu_set_t>& GetNumaNodes()
+{
+    static const std::vector<cpu_set_t> nodes = []
+    {
+        // Node numbers can have gaps, and directory order is arbitrary
+        std::vector<int> numbers;
+        if (DIR* dir = opendir("/sys/devices/system/node"))
+        {
+            while (dirent* entry = readdir(dir))
+            {
+                int number;
+                char extra;
+                if (sscanf(entry->d_name, "node%d%c", &number, &extra) == 1)
+                    numbers.push_back(number);
+            }
+            closedir(dir);
+        }
+        std::sort(numbers.begin(), numbers.end());
+
+        std::vector<cpu_set_t> found;
+        for (int number : numbers)
+        {
+            char path[64];
+            snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", number);
+            FILE* fp = fopen(path, "r");
+            if (!fp)
+                continue;
+
+            char text[4096];
+            cpu_set_t cpus;
+            if (fgets(text, sizeof(text), fp) && ParseCpuList(text, &cpus))
+                found.push_back(cpus);
+            fclose(fp);
+        }
+        return found;
+    }();
+    return nodes;
+}
+
+int GetNumaNodeCount()
+{
+    const size_t count = GetNumaNodes().size();
+    return count > 0 ? static_cast<int>(count) : 1;
+}
+
+bool BindThreadToNumaNode(int node)
+{
+    const std::vector<cpu_set_t>& nodes = GetNumaNodes();
+    if (node < 0 || node >= static_cast<int>(nodes.size()))
+        return false;
+
+    return sched_setaffinity(0, sizeof(cpu_set_t), &nodes[node]) == 0;
+}
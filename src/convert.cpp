@@ -0,0 +1,424 @@
+// VRAM to PNG conversion implementation
+#include "convert.h"
+#include "gsswizzle.h"
+#include "hash.h"
+#include "pngcache.h"
+#include "threadpool.h"
+
+#include <algorithm>
+#include <cstring>
+
+u64 HashConvertOptions(const ConvertOptions& options)
+{
+    const u32 fields[] =
+    {
+        static_cast<u32>(options.vram_width), options.psm, options.bp, options.has_rect,
+        static_cast<u32>(options.rect_x), static_cast<u32>(options.rect_y),
+        static_cast<u32>(options.rect_width), static_cast<u32>(options.rect_height),
+        options.has_clut, options.cbp, options.cpsm, options.csm, options.expand_clut, options.force_alpha,
+        options.detect_width, options.detect_region, static_cast<u32>(IsPngFormat(options.format) ? ImageFormat::Png : options.format),
+        static_cast<u32>(options.tile_order),
+    };
+    return HashBytes(fields, sizeof(fields));
+}
+
+void Converter::GetImageSize(const ConvertOptions& options, int* width, int* height)
+{
+    if (options.has_rect)
+    {
+        *width = options.rect_width;
+        *height = options.rect_height;
+        return;
+    }
+
+    // VRAM parameters
+    constexpr u32 VRAM_SIZE = 4 * 1024 * 1024;
+    const u32 total_pixels = VRAM_SIZE * 8 / GetPsmBitsPerPixel(options.psm);
+
+    *width = options.vram_width;
+    *height = total_pixels / options.vram_width;
+}
+
+// Page size of the format when options ask for tiled Raw output; otherwise false
+static bool GetTileSize(const ConvertOptions& options, int* width, int* height)
+{
+    if (options.tile_order == TileOrder::Linear || options.format != ImageFormat::Raw)
+        return false;
+
+    *width = GetPsmPageWidth(options.psm);
+    *height = GetPsmPageHeight(options.psm);
+    return true;
+}
+
+size_t Converter::GetImageBufferSize(const ConvertOptions& options)
+{
+    int width, height;
+    GetImageSize(options, &width, &height);
+
+    int tile_width, tile_height;
+    if (GetTileSize(options, &tile_width, &tile_height))
+    {
+        width = (width + tile_width - 1) / tile_width * tile_width;
+        height = (height + tile_height - 1) / tile_height * tile_height;
+    }
+
+    const bool palette = options.has_clut && IsIndexedPsm(options.psm) && !options.expand_clut && IsPngFormat(options.format);
+    return static_cast<size_t>(width) * height * (palette ? 1 : 4);
+}
+
+bool Converter::Load(const char* input_file, const ConvertOptions& options)
+{
+    ResetStats();
+    ScopedTimer timer(&m_stats.load_seconds);
+    bool result = m_dump.Open(input_file, options.load_mode);
+    m_stats.bytes_read = m_dump.GetBytesRead();
+    return result;
+}
+
+bool Converter::Load(const void* data, size_t size)
+{
+    ResetStats();
+    ScopedTimer timer(&m_stats.load_seconds);
+    bool result = m_dump.Open(data, size);
+    m_stats.bytes_read = m_dump.GetBytesRead();
+    return result;
+}
+
+void Converter::Deswizzle(const ConvertOptions& options, ThreadPool* pool)
+{
+    Deswizzle(m_dump.GetVRAM(), options, pool);
+}
+
+void Converter::Deswizzle(const u8* vram, const ConvertOptions& options, ThreadPool* pool)
+{
+    // resize keeps the allocation between jobs
+    ScopedTimer timer(&m_stats.deswizzle_seconds);
+    const ConvertOptions& layout = ResolveLayout(vram, options);
+    m_image.resize(PrepareImage(vram, layout));
+    DeswizzleImage(vram, layout, m_image.data(), pool);
+}
+
+bool Converter::Deswizzle(const ConvertOptions& options, u8* out, size_t out_size, ThreadPool* pool)
+{
+    ScopedTimer timer(&m_stats.deswizzle_seconds);
+    const u8* vram = m_dump.GetVRAM();
+    if (!vram)
+        return false;
+
+    const ConvertOptions& layout = ResolveLayout(vram, options);
+    if (out_size < PrepareImage(vram, layout))
+        return false;
+
+    DeswizzleImage(vram, layout, out, pool);
+    return true;
+}
+
+const ConvertOptions& Converter::ResolveLayout(const u8* vram, const ConvertOptions& options)
+{
+    m_layout = options;
+    if (options.detect_width || options.detect_region)
+        m_detector.Detect(vram, &m_layout);
+    return m_layout;
+}
+
+size_t Converter::PrepareImage(const u8* vram, const ConvertOptions& options)
+{
+    GetImageSize(options, &m_width, &m_height);
+
+    const bool use_clut = options.has_clut && IsIndexedPsm(options.psm) &&
+        ReadClut(vram, options.cbp, options.cpsm, options.csm, options.psm, options.force_alpha, m_palette);
+    m_paletteSize = use_clut && !options.expand_clut && IsPngFormat(options.format) ? GetClutEntryCount(options.psm) : 0;
+    m_hasClut = use_clut;
+
+    m_tileOrder = GetTileSize(options, &m_tileWidth, &m_tileHeight) ? options.tile_order : TileOrder::Linear;
+    if (m_tileOrder != TileOrder::Linear)
+    {
+        const size_t tiles_x = (m_width + m_tileWidth - 1) / m_tileWidth;
+        const size_t tiles_y = (m_height + m_tileHeight - 1) / m_tileHeight;
+        return tiles_x * tiles_y * m_tileWidth * m_tileHeight * 4;
+    }
+
+    return static_cast<size_t>(m_width) * m_height * (m_paletteSize ? 1 : 4);
+}
+
+void Converter::DeswizzleImage(const u8* vram, const ConvertOptions& options, u8* out, ThreadPool* pool)
+{
+    if (m_tileOrder != TileOrder::Linear)
+        DeswizzleTiles(vram, options, out, pool);
+    else
+        DeswizzleRows(vram, options, 0, m_height, out, pool);
+}
+
+void Converter::DeswizzleTiles(const u8* vram, const ConvertOptions& options, u8* out, ThreadPool* pool)
+{
+    const int tiles_x = (m_width + m_tileWidth - 1) / m_tileWidth;
+    const int tiles_y = (m_height + m_tileHeight - 1) / m_tileHeight;
+    const size_t tile_bytes = static_cast<size_t>(m_tileWidth) * m_tileHeight * 4;
+    m_stats.pixels += static_cast<u64>(m_width) * m_height;
+    if (m_tileOrder == TileOrder::Morton)
+        BuildMortonOrder();
+
+    // Tiles are written one after another, so every row of them is independent.
+    // Rows are dealt out to one slice per thread, each with its own scratch tile
+    // in m_band, so nothing is allocated once the band has grown.
+    const int slices = pool ? std::min(tiles_y, pool->GetThreadCount()) : 1;
+    m_band.resize(static_cast<size_t>(slices) * tile_bytes);
+
+    auto slice_rows = [&](int slice)
+    {
+        u8* scratch = m_band.data() + static_cast<size_t>(slice) * tile_bytes;
+        for (int tile_y = slice; tile_y < tiles_y; tile_y += slices)
+        {
+            for (int tile_x = 0; tile_x < tiles_x; tile_x++)
+                DeswizzleTile(vram, options, tile_x, tile_y, out + (static_cast<size_t>(tile_y) * tiles_x + tile_x) * tile_bytes, scratch);
+        }
+    };
+
+    if (pool)
+        pool->ParallelFor(slices, slice_rows);
+    else
+        slice_rows(0);
+}
+
+void Converter::DeswizzleTile(const u8* vram, const ConvertOptions& options, int tile_x, int tile_y, u8* out, u8* scratch) const
+{
+    // Edge tiles hold only the part of the image that reaches into them
+    const int x = tile_x * m_tileWidth;
+    const int y = tile_y * m_tileHeight;
+    const int width = std::min(m_tileWidth, m_width - x);
+    const int height = std::min(m_tileHeight, m_height - y);
+    const int vram_x = (options.has_rect ? options.rect_x : 0) + x;
+    const int vram_y = (options.has_rect ? options.rect_y : 0) + y;
+    const u32 buffer_width = options.vram_width / 64;
+    const u32* palette = m_hasClut ? m_palette : nullptr;
+
+    // Whole tiles in scanlines are deswizzled in place
+    if (m_tileOrder == TileOrder::Pages && width == m_tileWidth && height == m_tileHeight)
+    {
+        DeswizzleRect(vram, out, vram_x, vram_y, width, height, options.bp, buffer_width, options.psm, options.force_alpha, palette);
+        return;
+    }
+
+    DeswizzleRect(vram, scratch, vram_x, vram_y, width, height, options.bp, buffer_width, options.psm, options.force_alpha, palette);
+    const u32* pixels = reinterpret_cast<const u32*>(scratch);
+    u32* tile = reinterpret_cast<u32*>(out);
+
+    if (m_tileOrder == TileOrder::Pages)
+    {
+        for (int row = 0; row < m_tileHeight; row++)
+        {
+            const int copied = row < height ? width : 0;
+            memcpy(tile + row * m_tileWidth, pixels + row * width, copied * 4);
+            memset(tile + row * m_tileWidth + copied, 0, (m_tileWidth - copied) * 4);
+        }
+        return;
+    }
+
+    // Writes run straight through the tile; the reads stay inside one page of pixels
+    for (size_t i = 0; i < m_mortonOrder.size(); i++)
+    {
+        const int px = static_cast<int>(m_mortonOrder[i] & 0xFFFF);
+        const int py = static_cast<int>(m_mortonOrder[i] >> 16);
+        tile[i] = px < width && py < height ? pixels[py * width + px] : 0;
+    }
+}
+
+void Converter::BuildMortonOrder()
+{
+    // Every page size has its own pixel count, so the size identifies the table
+    const size_t count = static_cast<size_t>(m_tileWidth) * m_tileHeight;
+    if (m_mortonOrder.size() == count)
+        return;
+
+    // x and y bits alternate from the bottom, x first; the wider side's extra bits go on top
+    m_mortonOrder.resize(count);
+    for (int y = 0; y < m_tileHeight; y++)
+    {
+        for (int x = 0; x < m_tileWidth; x++)
+        {
+            u32 code = 0;
+            int bit = 0;
+            for (int b = 0; (1 << b) < std::max(m_tileWidth, m_tileHeight); b++)
+            {
+                if ((1 << b) < m_tileWidth)
+                    code |= static_cast<u32>((x >> b) & 1) << bit++;
+                if ((1 << b) < m_tileHeight)
+                    code |= static_cast<u32>((y >> b) & 1) << bit++;
+            }
+            m_mortonOrder[code] = static_cast<u32>(y) << 16 | static_cast<u32>(x);
+        }
+    }
+}
+
+void Converter::DeswizzleRows(const u8* vram, const ConvertOptions& options, int first_row, int row_count, u8* out, ThreadPool* pool)
+{
+    const u32 buffer_width = options.vram_width / 64;
+    const int x = options.has_rect ? options.rect_x : 0;
+    const int y = (options.has_rect ? options.rect_y : 0) + first_row;
+    m_stats.pixels += static_cast<u64>(m_width) * row_count;
+
+    if (m_paletteSize)
+    {
+        // One index byte per pixel, written as a palette PNG
+        if (pool)
+            ExtractIndexRect(vram, out, x, y, m_width, row_count, options.bp, buffer_width, options.psm, *pool);
+        else
+            ExtractIndexRect(vram, out, x, y, m_width, row_count, options.bp, buffer_width, options.psm);
+        return;
+    }
+
+    const u32* palette = m_hasClut ? m_palette : nullptr;
+    if (pool)
+        DeswizzleRect(vram, out, x, y, m_width, row_count, options.bp, buffer_width, options.psm, options.force_alpha, palette, *pool);
+    else
+        DeswizzleRect(vram, out, x, y, m_width, row_count, options.bp, buffer_width, options.psm, options.force_alpha, palette);
+}
+
+bool Converter::Encode(const ConvertOptions& options, std::vector<u8>* out, ThreadPool* pool)
+{
+    return Encode(m_image.data(), options, out, pool);
+}
+
+bool Converter::Encode(const u8* image, const ConvertOptions& options, std::vector<u8>* out, ThreadPool* pool)
+{
+    ScopedTimer timer(&m_stats.encode_seconds);
+    bool result;
+    if (m_paletteSize)
+        result = m_encoder.EncodeIndexed(image, m_width, m_height, m_width, m_palette, m_paletteSize, options.png_speed, pool, out);
+    else
+        result = m_encoder.Encode(image, m_width, m_height, m_width * 4, options.png_speed, pool, out);
+
+    if (result)
+        m_stats.png_bytes += out->size();
+    return result;
+}
+
+bool Converter::Write(const char* output_file, const ConvertOptions& options, ThreadPool* pool)
+{
+    if (!IsPngFormat(options.format))
+        return WriteImage(output_file, options.format);
+
+    if (!Encode(options, &m_png, pool))
+        return false;
+
+    ScopedTimer timer(&m_stats.write_seconds);
+    return WritePNGFile(output_file, m_png);
+}
+
+bool Converter::WriteImage(const char* output_file, ImageFormat format)
+{
+    // QOI is encoded whole; the other formats are a header in front of the image as it is
+    const size_t image_size = m_image.size();
+    const u8* pixels = m_image.data();
+    size_t pixels_size = image_size;
+    {
+        ScopedTimer timer(&m_stats.encode_seconds);
+        if (format == ImageFormat::Qoi)
+        {
+            if (!EncodeQOI(m_image.data(), m_width, m_height, m_width * 4, &m_png))
+                return false;
+            pixels = nullptr;
+            pixels_size = 0;
+        }
+        else
+        {
+            GetImageHeader(format, m_width, m_height, &m_png);
+        }
+    }
+
+    m_stats.png_bytes += m_png.size() + pixels_size;
+    ScopedTimer timer(&m_stats.write_seconds);
+    return WriteImageFile(output_file, m_png.data(), m_png.size(), pixels, pixels_size) &&
+        (format != ImageFormat::Raw || IsStdoutPath(output_file) || WriteRawSidecar(output_file, m_width, m_height, m_tileOrder, m_tileWidth, m_tileHeight));
+}
+
+bool Converter::Stream(const u8* vram, const char* output_file, const ConvertOptions& options)
+{
+    const ConvertOptions* layout;
+    {
+        ScopedTimer timer(&m_stats.deswizzle_seconds);
+        layout = &ResolveLayout(vram, options);
+        PrepareImage(vram, *layout);
+    }
+
+    bool ok;
+    {
+        ScopedTimer timer(&m_stats.encode_seconds);
+        if (m_paletteSize)
+            ok = m_stream.OpenIndexed(output_file, m_width, m_height, m_palette, m_paletteSize, options.png_speed);
+        else
+            ok = m_stream.Open(output_file, m_width, m_height, options.png_speed);
+    }
+
+    // Bands end on page rows of the buffer, so each band reads its pages once
+    const int page_height = GetPsmPageHeight(layout->psm);
+    const int first_y = layout->has_rect ? layout->rect_y : 0;
+    const size_t row_bytes = static_cast<size_t>(m_width) * (m_paletteSize ? 1 : 4);
+    m_band.resize(row_bytes * page_height);
+
+    for (int row = 0; ok && row < m_height;)
+    {
+        const int band_end = std::min(((first_y + row) / page_height + 1) * page_height - first_y, m_height);
+        const int row_count = band_end - row;
+        {
+            ScopedTimer timer(&m_stats.deswizzle_seconds);
+            DeswizzleRows(vram, *layout, row, row_count, m_band.data(), nullptr);
+        }
+
+        ScopedTimer timer(&m_stats.encode_seconds);
+        ok = m_stream.WriteRows(m_band.data(), row_count, row_bytes);
+        row = band_end;
+    }
+
+    ScopedTimer timer(&m_stats.encode_seconds);
+    ok = m_stream.Close() && ok;
+    if (ok)
+        m_stats.png_bytes += m_stream.GetBytesWritten();
+    return ok;
+}
+
+bool Converter::Save(const char* output_file, const ConvertOptions& options, ThreadPool* pool)
+{
+    // Raw output is no slower to write than to link, and has a sidecar besides;
+    // standard output cannot be linked at all
+    const bool use_cache = options.cache_dir && options.format != ImageFormat::Raw && !IsStdoutPath(output_file);
+    u64 key = 0;
+    if (use_cache)
+    {
+        {
+            // Hashing reads all of VRAM, so it counts as loading
+            ScopedTimer timer(&m_stats.load_seconds);
+            key = GetPngCacheKey(m_dump.GetVRAM(), options);
+        }
+
+        ScopedTimer timer(&m_stats.write_seconds);
+        if (FetchCachedPng(options.cache_dir, key, output_file))
+        {
+            m_stats.cache_hits++;
+            return true;
+        }
+    }
+
+    // Without threads to spread a strip over, stream rather than holding the image
+    const bool stream = IsPngFormat(options.format) && options.png_speed != PngSpeed::Max && (!pool || pool->GetThreadCount() <= 1);
+    if (stream)
+    {
+        if (!Stream(m_dump.GetVRAM(), output_file, options))
+            return false;
+    }
+    else
+    {
+        Deswizzle(options, pool);
+        if (!Write(output_file, options, pool))
+            return false;
+    }
+
+    if (use_cache)
+        StoreCachedPng(options.cache_dir, key, output_file);
+    return true;
+}
+
+bool Converter::Convert(const char* input_file, const char* output_file, const ConvertOptions& options)
+{
+    return Load(input_file, options) && Save(output_file, options);
+}
@@ -0,0 +1,744 @@
+// Raw DEFLATE encoding and zlib decoding implementation
+//
+// Fixed Huffman codes only, with a hash-chain LZ77 search and one step of
+// lazy matching, similar to stbi_zlib_compress but with a bounded chain walk
+// and a head/prev table instead of per-bucket arrays. The decoder handles
+// every block type, with a table lookup for codes of up to 10 bits.
+#include "deflate.h"
+
+#include <cstring>
+
+static const int WINDOW_SIZE = 32768;
+static const int WINDOW_MASK = WINDOW_SIZE - 1;
+static const int HASH_BITS = 15;
+static const int HASH_SIZE = 1 << HASH_BITS;
+static const int MIN_MATCH = 3;
+static const int MAX_MATCH = 258;
+
+static const u16 lengthBase[29] = { 3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258 };
+static const u8 lengthExtra[29] = { 0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0 };
+static const u16 distBase[30] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577 };
+static const u8 distExtra[30] = { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13 };
+
+// Fixed Huffman codes, bit-reversed for LSB-first output, with length/distance
+// symbol lookups folded in so each token costs a couple of table reads
+struct FixedCodes
+{
+    u16 litCode[288];
+    u8 litBits[288];
+    u8 lengthSymbol[MAX_MATCH + 1];
+    u8 distSymbol[512];     // distances 1..256 directly, larger ones by (d - 1) >> 7
+
+    FixedCodes()
+    {
+        for (int n = 0; n < 288; n++)
+        {
+            int code, bits;
+            if (n <= 143)      { code = 0x30 + n;          bits = 8; }
+            else if (n <= 255) { code = 0x190 + n - 144;   bits = 9; }
+            else if (n <= 279) { code = n - 256;           bits = 7; }
+            else               { code = 0xC0 + n - 280;    bits = 8; }
+            litCode[n] = static_cast<u16>(Reverse(code, bits));
+            litBits[n] = static_cast<u8>(bits);
+        }
+
+        for (int len = MIN_MATCH, s = 0; len <= MAX_MATCH; len++)
+        {
+            while (s < 28 && len >= lengthBase[s + 1])
+                s++;
+            lengthSymbol[len] = static_cast<u8>(s);
+        }
+
+        for (int d = 1, s = 0; d <= 256; d++)
+        {
+            while (s < 29 && d >= distBase[s + 1])
+                s++;
+            distSymbol[d - 1] = static_cast<u8>(s);
+        }
+        for (int i = 2, s = 0; i < 256; i++)
+        {
+            int d = (i << 7) + 1;
+            while (s < 29 && d >= distBase[s + 1])
+                s++;
+            distSymbol[256 + i] = static_cast<u8>(s);
+        }
+    }
+
+    static int Reverse(int code, int bits)
+    {
+        int result = 0;
+        while (bits--)
+        {
+            result = (result << 1) | (code & 1);
+            code >>= 1;
+        }
+        return result;
+    }
+
+    int GetDistSymbol(int dist) const
+    {
+        return dist <= 256 ? distSymbol[dist - 1] : distSymbol[256 + ((dist - 1) >> 7)];
+    }
+};
+
+static const FixedCodes& GetFixedCodes()
+{
+    static const FixedCodes codes;
+    return codes;
+}
+
+class BitWriter
+{
+public:
+    explicit BitWriter(std::vector<u8>* out) : m_out(out), m_bits(0), m_count(0) {}
+
+    void Put(u32 value, int bits)
+    {
+        m_bits |= static_cast<u64>(value) << m_count;
+        m_count += bits;
+        if (m_count >= 32)
+        {
+            u8 bytes[4] = { static_cast<u8>(m_bits), static_cast<u8>(m_bits >> 8), static_cast<u8>(m_bits >> 16), static_cast<u8>(m_bits >> 24) };
+            m_out->insert(m_out->end(), bytes, bytes + 4);
+            m_bits >>= 32;
+            m_count -= 32;
+        }
+    }
+
+    // Pad with zero bits to the next byte boundary
+    void Align()
+    {
+        while (m_count > 0)
+        {
+            m_out->push_back(static_cast<u8>(m_bits));
+            m_bits >>= 8;
+            m_count = m_count > 8 ? m_count - 8 : 0;
+        }
+        m_bits = 0;
+    }
+
+private:
+    std::vector<u8>* m_out;
+    u64 m_bits;
+    int m_count;
+};
+
+static inline u32 Hash3(const u8* p)
+{
+    u32 v = p[0] | (p[1] << 8) | (p[2] << 16);
+    return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+static inline int MatchLength(const u8* a, const u8* b, int limit)
+{
+    int len = 0;
+    while (len + 8 <= limit)
+    {
+        u64 x, y;
+        memcpy(&x, a + len, 8);
+        memcpy(&y, b + len, 8);
+        if (x != y)
+            return len + (__builtin_ctzll(x ^ y) >> 3);
+        len += 8;
+    }
+    while (len < limit && a[len] == b[len])
+        len++;
+    return len;
+}
+
+// Hash tables are kept per thread, so compressing a chunk does not allocate
+// once a thread has compressed its first one
+static thread_local std::vector<int> matchHead;
+static thread_local std::vector<int> matchPrev;
+
+struct MatchFinder
+{
+    std::vector<int>& head;
+    std::vector<int>& prev;
+    const u8* data;
+    int maxChain;
+
+    MatchFinder(const u8* d, int chain)
+        : head(matchHead), prev(matchPrev), data(d), maxChain(chain)
+    {
+        // Cleared every time so the output never depends on earlier chunks
+        head.assign(HASH_SIZE, -1);
+        prev.assign(WINDOW_SIZE, -1);
+    }
+
+    void Insert(size_t pos)
+    {
+        u32 h = Hash3(data + pos);
+        prev[pos & WINDOW_MASK] = head[h];
+        head[h] = static_cast<int>(pos);
+    }
+
+    // Longest match for pos among previously inserted positions; 0 if none
+    int Find(size_t pos, int limit, int* dist) const
+    {
+        int best = 0;
+        int candidate = head[Hash3(data + pos)];
+        for (int chain = maxChain; candidate >= 0 && chain > 0; chain--)
+        {
+            int d = static_cast<int>(pos) - candidate;
+            if (d <= 0 || d > WINDOW_SIZE)
+                break;
+
+            if (data[candidate + best] == data[pos + best])
+            {
+                int len = MatchLength(data + candidate, data + pos, limit);
+                if (len > best)
+                {
+                    best = len;
+                    *dist = d;
+                    if (len >= limit)
+                        break;
+                }
+            }
+
+            int next = prev[candidate & WINDOW_MASK];
+            if (next >= candidate)
+                break;
+            candidate = next;
+        }
+        return best >= MIN_MATCH ? best : 0;
+    }
+};
+
+// Non-final stored blocks; every chunk starts on a byte boundary so no padding is needed
+static void StoreChunk(const u8* data, size_t start, size_t end, std::vector<u8>* out)
+{
+    for (size_t pos = start; pos < end;)
+    {
+        size_t len = end - pos < 65535 ? end - pos : 65535;
+        const u8 header[5] = { 0x00, static_cast<u8>(len), static_cast<u8>(len >> 8), static_cast<u8>(~len), static_cast<u8>(~len >> 8) };
+        out->insert(out->end(), header, header + 5);
+        out->insert(out->end(), data + pos, data + pos + len);
+        pos += len;
+    }
+}
+
+// Token output for one chunk: a non-final fixed-Huffman block closed by a sync flush
+class FixedBlockWriter
+{
+public:
+    explicit FixedBlockWriter(std::vector<u8>* out)
+        : m_codes(GetFixedCodes()), m_writer(out), m_out(out), m_start(out->size())
+    {
+        // BFINAL = 0, BTYPE = 1 (fixed Huffman)
+        m_writer.Put(2, 3);
+    }
+
+    void Literal(u8 value)
+    {
+        m_writer.Put(m_codes.litCode[value], m_codes.litBits[value]);
+    }
+
+    void Match(int len, int dist)
+    {
+        int ls = m_codes.lengthSymbol[len];
+        m_writer.Put(m_codes.litCode[257 + ls], m_codes.litBits[257 + ls]);
+        if (lengthExtra[ls])
+            m_writer.Put(len - lengthBase[ls], lengthExtra[ls]);
+
+        int ds = m_codes.GetDistSymbol(dist);
+        m_writer.Put(FixedCodes::Reverse(ds, 5), 5);
+        if (distExtra[ds])
+            m_writer.Put(dist - distBase[ds], distExtra[ds]);
+    }
+
+    // End of block, then an empty stored block to byte-align (sync flush).
+    // Falls back to stored blocks if compression made the chunk larger.
+    void Finish(const u8* data, size_t start, size_t end)
+    {
+        m_writer.Put(m_codes.litCode[256], m_codes.litBits[256]);
+        m_writer.Put(0, 3);
+        m_writer.Align();
+
+        const u8 stored[4] = { 0x00, 0x00, 0xFF, 0xFF };
+        m_out->insert(m_out->end(), stored, stored + 4);
+
+        const size_t stored_size = (end - start) + ((end - start + 65534) / 65535) * 5;
+        if (m_out->size() - m_start > stored_size)
+        {
+            m_out->resize(m_start);
+            StoreChunk(data, start, end, m_out);
+        }
+    }
+
+private:
+    const FixedCodes& m_codes;
+    BitWriter m_writer;
+    std::vector<u8>* m_out;
+    size_t m_start;
+};
+
+void DeflateCompressChunk(const u8* data, size_t start, size_t end, int quality, std::vector<u8>* out)
+{
+    FixedBlockWriter writer(out);
+
+    if (quality < 5)
+        quality = 5;
+    MatchFinder finder(data, quality * 2);
+
+    // Prime the window with the data preceding this chunk
+    const size_t window_start = start > static_cast<size_t>(WINDOW_SIZE) ? start - WINDOW_SIZE : 0;
+    for (size_t pos = window_start; pos < start && pos + MIN_MATCH <= end; pos++)
+        finder.Insert(pos);
+
+    size_t i = start;
+    while (i + MIN_MATCH <= end)
+    {
+        const int limit = end - i < static_cast<size_t>(MAX_MATCH) ? static_cast<int>(end - i) : MAX_MATCH;
+        int dist = 0;
+        int len = finder.Find(i, limit, &dist);
+        finder.Insert(i);
+
+        // Lazy matching: prefer a literal if the next byte starts a longer match
+        if (len > 0 && len < 32 && i + 1 + MIN_MATCH <= end)
+        {
+            int next_dist;
+            int next_limit = limit < static_cast<int>(end - i - 1) ? limit : static_cast<int>(end - i - 1);
+            if (finder.Find(i + 1, next_limit, &next_dist) > len)
+                len = 0;
+        }
+
+        if (len == 0)
+        {
+            writer.Literal(data[i]);
+            i++;
+            continue;
+        }
+
+        writer.Match(len, dist);
+
+        for (size_t end_match = i + len, pos = i + 1; pos < end_match; pos++)
+        {
+            if (pos + MIN_MATCH <= end)
+                finder.Insert(pos);
+        }
+        i += len;
+    }
+
+    // Write out final bytes
+    for (; i < end; i++)
+        writer.Literal(data[i]);
+
+    writer.Finish(data, start, end);
+}
+
+void DeflateCompressChunkRLE(const u8* data, size_t start, size_t end, int pixel_size, std::vector<u8>* out)
+{
+    FixedBlockWriter writer(out);
+
+    // Only repeats of the previous byte or the previous pixel are considered,
+    // which is what flat and empty VRAM regions reduce to after filtering
+    const int distances[2] = { 1, pixel_size };
+
+    size_t i = start;
+    while (i + MIN_MATCH <= end)
+    {
+        const int limit = end - i < static_cast<size_t>(MAX_MATCH) ? static_cast<int>(end - i) : MAX_MATCH;
+        int best = 0;
+        int best_dist = 0;
+        for (int dist : distances)
+        {
+            if (i < static_cast<size_t>(dist) || data[i] != data[i - dist])
+                continue;
+
+            int len = MatchLength(data + i - dist, data + i, limit);
+            if (len > best)
+            {
+                best = len;
+                best_dist = dist;
+            }
+        }
+
+        if (best < MIN_MATCH)
+        {
+            writer.Literal(data[i]);
+            i++;
+            continue;
+        }
+
+        writer.Match(best, best_dist);
+        i += best;
+    }
+
+    for (; i < end; i++)
+        writer.Literal(data[i]);
+
+    writer.Finish(data, start, end);
+}
+
+void DeflateFinish(std::vector<u8>* out)
+{
+    // BFINAL = 1, BTYPE = 1, end of block
+    out->push_back(0x03);
+    out->push_back(0x00);
+}
+
+// Decoding
+
+static const int FAST_BITS = 10;
+
+// Canonical Huffman decoding table. fast[] maps the next FAST_BITS input bits
+// to (symbol << 4) | length for short codes; longer codes are decoded
+// canonically from counts and symbols.
+struct HuffmanTable
+{
+    u16 fast[1 << FAST_BITS];
+    u16 counts[16];
+    u16 symbols[288];
+
+    bool Build(const u8* lengths, int count)
+    {
+        memset(fast, 0, sizeof(fast));
+        memset(counts, 0, sizeof(counts));
+        for (int i = 0; i < count; i++)
+            counts[lengths[i]]++;
+        counts[0] = 0;
+
+        // Reject over-subscribed code sets
+        int left = 1;
+        for (int len = 1; len < 16; len++)
+        {
+            left = (left << 1) - counts[len];
+            if (left < 0)
+                return false;
+        }
+
+        u16 offsets[16];
+        u16 next_code[16];
+        offsets[1] = 0;
+        next_code[1] = 0;
+        for (int len = 1; len < 15; len++)
+        {
+            offsets[len + 1] = offsets[len] + counts[len];
+            next_code[len + 1] = static_cast<u16>((next_code[len] + counts[len]) << 1);
+        }
+
+        for (int i = 0; i < count; i++)
+        {
+            const int len = lengths[i];
+            if (len == 0)
+                continue;
+
+            symbols[offsets[len]++] = static_cast<u16>(i);
+            const int code = next_code[len]++;
+            if (len <= FAST_BITS)
+            {
+                // Codes are sent MSB first into an LSB-first stream
+                const u16 entry = static_cast<u16>((i << 4) | len);
+                for (int j = FixedCodes::Reverse(code, len); j < (1 << FAST_BITS); j += 1 << len)
+                    fast[j] = entry;
+            }
+        }
+        return true;
+    }
+};
+
+class BitReader
+{
+public:
+    BitReader(const u8* data, size_t size)
+        : m_data(data)
+        , m_size(size)
+        , m_pos(0)
+        , m_bits(0)
+        , m_count(0)
+    {
+    }
+
+    // Bytes past the end read as zeros; Overrun() tells whether any were used
+    u32 Peek(int n)
+    {
+        while (m_count < n)
+        {
+            const u32 byte = m_pos < m_size ? m_data[m_pos] : 0;
+            m_pos++;
+            m_bits |= static_cast<u64>(byte) << m_count;
+            m_count += 8;
+        }
+        return static_cast<u32>(m_bits & ((1ull << n) - 1));
+    }
+
+    void Drop(int n)
+    {
+        m_bits >>= n;
+        m_count -= n;
+    }
+
+    u32 Get(int n)
+    {
+        u32 value = Peek(n);
+        Drop(n);
+        return value;
+    }
+
+    // Discard the rest of the current byte and hand back whole buffered bytes
+    void AlignToByte()
+    {
+        Drop(m_count & 7);
+        m_pos -= m_count / 8;
+        m_bits = 0;
+        m_count = 0;
+    }
+
+    bool Overrun() const { return m_pos - m_count / 8 > m_size; }
+    size_t GetPosition() const { return m_pos; }
+    const u8* GetData() const { return m_data + m_pos; }
+    size_t GetRemaining() const { return m_pos < m_size ? m_size - m_pos : 0; }
+    void Advance(size_t n) { m_pos += n; }
+
+private:
+    const u8* m_data;
+    size_t m_size;
+    size_t m_pos;
+    u64 m_bits;
+    int m_count;
+};
+
+static int DecodeSymbol(BitReader& in, const HuffmanTable& table)
+{
+    const u16 entry = table.fast[in.Peek(FAST_BITS)];
+    if (entry)
+    {
+        in.Drop(entry & 15);
+        return entry >> 4;
+    }
+
+    // Walk the canonical code one bit at a time
+    int code = 0;
+    int first = 0;
+    int index = 0;
+    for (int len = 1; len < 16; len++)
+    {
+        code |= in.Get(1);
+        const int count = table.counts[len];
+        if (code - first < count)
+            return table.symbols[index + code - first];
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+static const HuffmanTable* GetFixedTables()
+{
+    struct FixedTables
+    {
+        HuffmanTable tables[2];
+
+        FixedTables()
+        {
+            u8 lengths[288];
+            for (int i = 0; i < 288; i++)
+                lengths[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+            tables[0].Build(lengths, 288);
+
+            memset(lengths, 5, 30);
+            tables[1].Build(lengths, 30);
+        }
+    };
+    static const FixedTables fixed;
+    return fixed.tables;
+}
+
+static bool ReadDynamicTables(BitReader& in, HuffmanTable* lit, HuffmanTable* dist)
+{
+    static const u8 order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+    const int lit_count = in.Get(5) + 257;
+    const int dist_count = in.Get(5) + 1;
+    const int code_count = in.Get(4) + 4;
+    if (lit_count > 286 || dist_count > 30)
+        return false;
+
+    u8 lengths[286 + 30] = {};
+    for (int i = 0; i < code_count; i++)
+        lengths[order[i]] = static_cast<u8>(in.Get(3));
+
+    HuffmanTable codes;
+    if (!codes.Build(lengths, 19))
+        return false;
+
+    memset(lengths, 0, 19);
+    for (int i = 0; i < lit_count + dist_count;)
+    {
+        int symbol = DecodeSymbol(in, codes);
+        if (symbol < 0)
+            return false;
+
+        if (symbol < 16)
+        {
+            lengths[i++] = static_cast<u8>(symbol);
+            continue;
+        }
+
+        u8 value = 0;
+        int repeat;
+        if (symbol == 16)
+        {
+            if (i == 0)
+                return false;
+            value = lengths[i - 1];
+            repeat = 3 + in.Get(2);
+        }
+        else if (symbol == 17)
+        {
+            repeat = 3 + in.Get(3);
+        }
+        else
+        {
+            repeat = 11 + in.Get(7);
+        }
+
+        if (i + repeat > lit_count + dist_count)
+            return false;
+        while (repeat--)
+            lengths[i++] = value;
+    }
+
+    return lengths[256] != 0 && lit->Build(lengths, lit_count) && dist->Build(lengths + lit_count, dist_count);
+}
+
+static bool InflateBlock(BitReader& in, const HuffmanTable& lit, const HuffmanTable& dist, std::vector<u8>* out)
+{
+    for (;;)
+    {
+        int symbol = DecodeSymbol(in, lit);
+        if (symbol < 0 || in.Overrun())
+            return false;
+
+        if (symbol < 256)
+        {
+            out->push_back(static_cast<u8>(symbol));
+            continue;
+        }
+        if (symbol == 256)
+            return true;
+
+        symbol -= 257;
+        if (symbol >= 29)
+            return false;
+        const int length = lengthBase[symbol] + in.Get(lengthExtra[symbol]);
+
+        const int dist_symbol = DecodeSymbol(in, dist);
+        if (dist_symbol < 0 || dist_symbol >= 30)
+            return false;
+        const size_t distance = distBase[dist_symbol] + in.Get(distExtra[dist_symbol]);
+        if (distance > out->size())
+            return false;
+
+        // Copies may overlap their own output
+        size_t from = out->size() - distance;
+        out->resize(out->size() + length);
+        u8* dst = out->data() + out->size() - length;
+        const u8* src = out->data() + from;
+        for (int i = 0; i < length; i++)
+            dst[i] = src[i];
+    }
+}
+
+bool ZlibDecompress(const u8* data, size_t size, std::vector<u8>* out)
+{
+    // CM = 8 (deflate), header checksum, no preset dictionary
+    if (size < 6 || (data[0] & 0x0F) != 8 || ((data[0] << 8) | data[1]) % 31 != 0 || (data[1] & 0x20))
+        return false;
+
+    const size_t start = out->size();
+    BitReader in(data + 2, size - 2);
+    HuffmanTable lit, dist;
+
+    bool final = false;
+    while (!final)
+    {
+        final = in.Get(1) != 0;
+        const u32 type = in.Get(2);
+
+        if (type == 0)
+        {
+            in.AlignToByte();
+            if (in.GetRemaining() < 4)
+                return false;
+            const u8* header = in.GetData();
+            const u32 len = header[0] | (header[1] << 8);
+            const u32 nlen = header[2] | (header[3] << 8);
+            in.Advance(4);
+            if ((len ^ 0xFFFF) != nlen || in.GetRemaining() < len)
+                return false;
+
+            out->insert(out->end(), in.GetData(), in.GetData() + len);
+            in.Advance(len);
+        }
+        else if (type == 1)
+        {
+            const HuffmanTable* fixed = GetFixedTables();
+            if (!InflateBlock(in, fixed[0], fixed[1], out))
+                return false;
+        }
+        else if (type == 2)
+        {
+            if (!ReadDynamicTables(in, &lit, &dist) || !InflateBlock(in, lit, dist, out))
+                return false;
+        }
+        else
+        {
+            return false;
+        }
+
+        if (in.Overrun())
+            return false;
+    }
+
+    // Adler-32 of the uncompressed data follows, big endian
+    in.AlignToByte();
+    if (in.GetRemaining() < 4)
+        return false;
+    const u8* check = in.GetData();
+    const u32 expected = (static_cast<u32>(check[0]) << 24) | (check[1] << 16) | (check[2] << 8) | check[3];
+    return Adler32(out->data() + start, out->size() - start) == expected;
+}
+
+u32 Adler32(const u8* data, size_t len, u32 adler)
+{
+    const u32 MOD_ADLER = 65521;
+    u32 s1 = adler & 0xFFFF;
+    u32 s2 = adler >> 16;
+
+    while (len > 0)
+    {
+        // 5552 is the largest run that cannot overflow s2 before the modulo
+        size_t block = len < 5552 ? len : 5552;
+        len -= block;
+        while (block--)
+        {
+            s1 += *data++;
+            s2 += s1;
+        }
+        s1 %= MOD_ADLER;
+        s2 %= MOD_ADLER;
+    }
+
+    return (s2 << 16) | s1;
+}
+
+u32 Adler32Combine(u32 adler1, u32 adler2, size_t len2)
+{
+    const u32 MOD_ADLER = 65521;
+    const u32 rem = static_cast<u32>(len2 % MOD_ADLER);
+
+    u32 s1 = adler1 & 0xFFFF;
+    u32 s2 = (rem * s1) % MOD_ADLER;
+    s1 += (adler2 & 0xFFFF) + MOD_ADLER - 1;
+    s2 += (adler1 >> 16) + (adler2 >> 16) + MOD_ADLER - rem;
+
+    if (s1 >= MOD_ADLER) s1 -= MOD_ADLER;
+    if (s1 >= MOD_ADLER) s1 -= MOD_ADLER;
+    if (s2 >= (MOD_ADLER << 1)) s2 -= (MOD_ADLER << 1);
+    if (s2 >= MOD_ADLER) s2 -= MOD_ADLER;
+
+    return (s2 << 16) | s1;
+}
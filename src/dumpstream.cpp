@@ -0,0 +1,474 @@
+// Sequential reader for raw and compressed GS dumps implementation
+#include "dumpstream.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef GS2PNG_XZ
+#include <lzma.h>
+#endif
+
+#ifdef GS2PNG_ZSTD
+#include <zstd.h>
+#endif
+
+// Decoded data is handed out from a 1MB buffer; compressed input is read 256KB at a time
+static const size_t OUTPUT_BUFFER_SIZE = 1024 * 1024;
+static const size_t INPUT_BUFFER_SIZE = 256 * 1024;
+
+static const char* const s_dumpExtensions[] = { ".gs", ".gs.xz", ".gs.zst" };
+
+size_t GetDumpExtensionLength(const char* name)
+{
+    const size_t len = strlen(name);
+    for (const char* ext : s_dumpExtensions)
+    {
+        const size_t ext_len = strlen(ext);
+        if (len >= ext_len && strcmp(name + len - ext_len, ext) == 0)
+            return ext_len;
+    }
+    return 0;
+}
+
+const char* GetDumpExtension(int index)
+{
+    const int count = sizeof(s_dumpExtensions) / sizeof(s_dumpExtensions[0]);
+    return index >= 0 && index < count ? s_dumpExtensions[index] : nullptr;
+}
+
+DumpStream::DumpStream()
+    : m_fd(-1)
+    , m_memory(nullptr)
+    , m_memorySize(0)
+    , m_memoryPos(0)
+    , m_compression(DumpCompression::None)
+    , m_decoder(nullptr)
+    , m_inputDone(false)
+    , m_streamEnd(false)
+    , m_error(false)
+    , m_bytesRead(0)
+    , m_input(nullptr)
+    , m_inputPos(0)
+    , m_inputSize(0)
+    , m_outputPos(0)
+    , m_outputEnd(0)
+{
+}
+
+DumpStream::~DumpStream()
+{
+    Close();
+}
+
+DumpCompression DumpStream::DetectCompression(const u8* data, size_t size)
+{
+    static const u8 xz_magic[6] = { 0xFD, '7', 'z', 'X', 'Z', 0x00 };
+    static const u8 zstd_magic[4] = { 0x28, 0xB5, 0x2F, 0xFD };
+
+    if (size >= sizeof(xz_magic) && memcmp(data, xz_magic, sizeof(xz_magic)) == 0)
+        return DumpCompression::Xz;
+    if (size >= sizeof(zstd_magic) && memcmp(data, zstd_magic, sizeof(zstd_magic)) == 0)
+        return DumpCompression::Zstd;
+    return DumpCompression::None;
+}
+
+bool DumpStream::IsSupported(DumpCompression compression)
+{
+    switch (compression)
+    {
+    case DumpCompression::None:
+        return true;
+    case DumpCompression::Xz:
+#ifdef GS2PNG_XZ
+        return true;
+#else
+        return false;
+#endif
+    case DumpCompression::Zstd:
+#ifdef GS2PNG_ZSTD
+        return true;
+#else
+        return false;
+#endif
+    }
+    return false;
+}
+
+const char* DumpStream::GetCompressionName(DumpCompression compression)
+{
+    switch (compression)
+    {
+    case DumpCompression::Xz: return "xz";
+    case DumpCompression::Zstd: return "zstd";
+    default: return "raw";
+    }
+}
+
+bool DumpStream::Open(const char* filename)
+{
+    Close();
+
+    if (strcmp(filename, "-") == 0)
+        return OpenPipe(dup(STDIN_FILENO));
+
+    m_fd = open(filename, O_RDONLY);
+    if (m_fd < 0)
+        return false;
+
+    // Peek at the magic without moving the file offset
+    u8 magic[6];
+    ssize_t magic_size = pread(m_fd, magic, sizeof(magic), 0);
+    m_compression = DetectCompression(magic, magic_size > 0 ? static_cast<size_t>(magic_size) : 0);
+    if (!IsSupported(m_compression))
+    {
+        fprintf(stderr, "Error: %s: %s compressed dumps are not supported by this build\n", filename, GetCompressionName(m_compression));
+        Close();
+        return false;
+    }
+
+    return InitDecoder();
+}
+
+// Pipes cannot be peeked at, so the magic is read and handed back as the first data
+bool DumpStream::OpenPipe(int fd)
+{
+    m_fd = fd;
+    if (m_fd < 0)
+        return false;
+
+    u8 magic[6];
+    size_t magic_size = 0;
+    while (magic_size < sizeof(magic))
+    {
+        ssize_t result = read(m_fd, magic + magic_size, sizeof(magic) - magic_size);
+        if (result < 0 && errno == EINTR)
+            continue;
+        if (result <= 0)
+            break;
+        magic_size += static_cast<size_t>(result);
+    }
+
+    m_compression = DetectCompression(magic, magic_size);
+    if (!IsSupported(m_compression))
+    {
+        fprintf(stderr, "Error: standard input: %s compressed dumps are not supported by this build\n", GetCompressionName(m_compression));
+        Close();
+        return false;
+    }
+
+    if (!InitDecoder())
+        return false;
+
+    m_bytesRead = magic_size;
+    if (m_compression == DumpCompression::None)
+    {
+        memcpy(m_output.data(), magic, magic_size);
+        m_outputEnd = magic_size;
+    }
+    else
+    {
+        memcpy(m_inputBuffer.data(), magic, magic_size);
+        m_input = m_inputBuffer.data();
+        m_inputSize = magic_size;
+    }
+    return true;
+}
+
+bool DumpStream::Open(const void* data, size_t size)
+{
+    Close();
+
+    m_memory = static_cast<const u8*>(data);
+    m_memorySize = size;
+    m_compression = DetectCompression(m_memory, size);
+    if (!IsSupported(m_compression))
+    {
+        fprintf(stderr, "Error: %s compressed dumps are not supported by this build\n", GetCompressionName(m_compression));
+        Close();
+        return false;
+    }
+    return InitDecoder();
+}
+
+bool DumpStream::InitDecoder()
+{
+    // Buffers are kept across opens
+    if (m_output.empty())
+        m_output.resize(OUTPUT_BUFFER_SIZE);
+    if (m_compression != DumpCompression::None && !m_memory && m_inputBuffer.empty())
+        m_inputBuffer.resize(INPUT_BUFFER_SIZE);
+
+#ifdef GS2PNG_XZ
+    if (m_compression == DumpCompression::Xz)
+    {
+        lzma_stream* strm = new lzma_stream;
+        *strm = LZMA_STREAM_INIT;
+        m_decoder = strm;
+        if (lzma_stream_decoder(strm, UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK)
+        {
+            Close();
+            return false;
+        }
+    }
+#endif
+
+#ifdef GS2PNG_ZSTD
+    if (m_compression == DumpCompression::Zstd)
+    {
+        ZSTD_DStream* stream = ZSTD_createDStream();
+        m_decoder = stream;
+        if (!stream || ZSTD_isError(ZSTD_initDStream(stream)))
+        {
+            Close();
+            return false;
+        }
+    }
+#endif
+
+    return true;
+}
+
+void DumpStream::Close()
+{
+#ifdef GS2PNG_XZ
+    if (m_decoder && m_compression == DumpCompression::Xz)
+    {
+        lzma_stream* strm = static_cast<lzma_stream*>(m_decoder);
+        lzma_end(strm);
+        delete strm;
+    }
+#endif
+
+#ifdef GS2PNG_ZSTD
+    if (m_decoder && m_compression == DumpCompression::Zstd)
+        ZSTD_freeDStream(static_cast<ZSTD_DStream*>(m_decoder));
+#endif
+
+    if (m_fd >= 0)
+        close(m_fd);
+
+    m_fd = -1;
+    m_memory = nullptr;
+    m_memorySize = 0;
+    m_memoryPos = 0;
+    m_compression = DumpCompression::None;
+    m_decoder = nullptr;
+    m_inputDone = false;
+    m_streamEnd = false;
+    m_error = false;
+    m_bytesRead = 0;
+    m_input = nullptr;
+    m_inputPos = 0;
+    m_inputSize = 0;
+    m_outputPos = 0;
+    m_outputEnd = 0;
+}
+
+size_t DumpStream::Read(void* data, size_t size)
+{
+    u8* dst = static_cast<u8*>(data);
+    size_t total = 0;
+    while (size > 0)
+    {
+        if (m_outputPos == m_outputEnd)
+        {
+            // Large reads decode straight into the caller's memory
+            if (size >= m_output.size())
+            {
+                size_t count = Decode(dst, size);
+                if (count == 0)
+                    break;
+                dst += count;
+                size -= count;
+                total += count;
+                continue;
+            }
+
+            m_outputPos = 0;
+            m_outputEnd = Decode(m_output.data(), m_output.size());
+            if (m_outputEnd == 0)
+                break;
+        }
+
+        size_t count = m_outputEnd - m_outputPos < size ? m_outputEnd - m_outputPos : size;
+        memcpy(dst, m_output.data() + m_outputPos, count);
+        m_outputPos += count;
+        dst += count;
+        size -= count;
+        total += count;
+    }
+    return total;
+}
+
+bool DumpStream::Skip(u64 size)
+{
+    const u64 buffered = m_outputEnd - m_outputPos;
+    if (size <= buffered)
+    {
+        m_outputPos += static_cast<size_t>(size);
+        return true;
+    }
+
+    size -= buffered;
+    m_outputPos = m_outputEnd = 0;
+
+    if (m_compression == DumpCompression::None && m_memory)
+    {
+        if (size > m_memorySize - m_memoryPos)
+        {
+            m_memoryPos = m_memorySize;
+            return false;
+        }
+        m_memoryPos += static_cast<size_t>(size);
+        return true;
+    }
+
+    if (m_compression == DumpCompression::None && m_fd >= 0 && lseek(m_fd, static_cast<off_t>(size), SEEK_CUR) >= 0)
+        return true;
+
+    // Compressed data (or a pipe) has to be decoded to be skipped
+    while (size > 0)
+    {
+        size_t count = Decode(m_output.data(), size < m_output.size() ? static_cast<size_t>(size) : m_output.size());
+        if (count == 0)
+            return false;
+        size -= count;
+    }
+    return true;
+}
+
+bool DumpStream::FillInput()
+{
+    // Memory sources hand the decoder everything at once
+    if (m_memory)
+    {
+        m_input = m_memory + m_memoryPos;
+        m_inputPos = 0;
+        m_inputSize = m_memorySize - m_memoryPos;
+        m_memoryPos = m_memorySize;
+        m_inputDone = m_inputSize == 0;
+        m_bytesRead += m_inputSize;
+        return m_inputSize > 0;
+    }
+
+    m_input = m_inputBuffer.data();
+    ssize_t result = read(m_fd, m_inputBuffer.data(), m_inputBuffer.size());
+    if (result < 0)
+        m_error = true;
+
+    m_inputPos = 0;
+    m_inputSize = result > 0 ? static_cast<size_t>(result) : 0;
+    m_inputDone = m_inputSize == 0;
+    m_bytesRead += m_inputSize;
+    return m_inputSize > 0;
+}
+
+size_t DumpStream::Decode(u8* data, size_t size)
+{
+    if ((m_fd < 0 && !m_memory) || m_error || m_streamEnd)
+        return 0;
+
+    switch (m_compression)
+    {
+    case DumpCompression::Xz:
+        return DecodeXz(data, size);
+    case DumpCompression::Zstd:
+        return DecodeZstd(data, size);
+    default:
+        break;
+    }
+
+    if (m_memory)
+    {
+        size_t count = m_memorySize - m_memoryPos < size ? m_memorySize - m_memoryPos : size;
+        memcpy(data, m_memory + m_memoryPos, count);
+        m_memoryPos += count;
+        m_bytesRead += count;
+        return count;
+    }
+
+    ssize_t result = read(m_fd, data, size);
+    if (result < 0)
+        m_error = true;
+    else
+        m_bytesRead += static_cast<size_t>(result);
+    return result > 0 ? static_cast<size_t>(result) : 0;
+}
+
+size_t DumpStream::DecodeXz(u8* data, size_t size)
+{
+#ifdef GS2PNG_XZ
+    lzma_stream* strm = static_cast<lzma_stream*>(m_decoder);
+    strm->next_out = data;
+    strm->avail_out = size;
+
+    // Stop as soon as anything was produced; callers ask again for more
+    while (strm->avail_out == size)
+    {
+        if (strm->avail_in == 0 && (m_inputPos < m_inputSize || (!m_inputDone && FillInput())))
+        {
+            strm->next_in = m_input + m_inputPos;
+            strm->avail_in = m_inputSize - m_inputPos;
+            m_inputPos = m_inputSize;
+        }
+
+        lzma_ret ret = lzma_code(strm, m_inputDone ? LZMA_FINISH : LZMA_RUN);
+        if (ret == LZMA_STREAM_END)
+        {
+            m_streamEnd = true;
+            break;
+        }
+        if (ret != LZMA_OK)
+        {
+            // Includes LZMA_BUF_ERROR for a truncated file
+            m_error = true;
+            break;
+        }
+    }
+    return size - strm->avail_out;
+#else
+    (void)data;
+    (void)size;
+    return 0;
+#endif
+}
+
+size_t DumpStream::DecodeZstd(u8* data, size_t size)
+{
+#ifdef GS2PNG_ZSTD
+    ZSTD_DStream* stream = static_cast<ZSTD_DStream*>(m_decoder);
+    ZSTD_outBuffer out = { data, size, 0 };
+
+    for (;;)
+    {
+        if (m_inputPos == m_inputSize && !m_inputDone)
+            FillInput();
+
+        ZSTD_inBuffer in = { m_input, m_inputSize, m_inputPos };
+        size_t ret = ZSTD_decompressStream(stream, &out, &in);
+        m_inputPos = in.pos;
+        if (ZSTD_isError(ret))
+        {
+            m_error = true;
+            break;
+        }
+        if (out.pos > 0)
+            break;
+        if (m_inputDone && m_inputPos == m_inputSize)
+        {
+            // A non-zero hint here means the last frame was cut short
+            m_error = ret != 0;
+            m_streamEnd = true;
+            break;
+        }
+    }
+    return out.pos;
+#else
+    (void)data;
+    (void)size;
+    return 0;
+#endif
+}
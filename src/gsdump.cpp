@@ -1,87 +1,258 @@
 // GS Dump file format parsing implementation
 #include "gsdump.h"
-#include <cstdlib>
+#include "buffers.h"
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 GSDumpFile::GSDumpFile()
     : m_vram(nullptr)
+    , m_buffer(nullptr)
+    , m_map(nullptr)
+    , m_mapSize(0)
+    , m_writable(false)
+    , m_bytesRead(0)
 {
 }
 
 GSDumpFile::~GSDumpFile()
 {
     Close();
+    FreeBuffer(m_buffer, VRAM_SIZE);
 }
 
-bool GSDumpFile::Open(const char* filename)
+bool GSDumpFile::Open(const char* filename, GSDumpLoadMode mode)
 {
     Close();
 
-    FILE* fp = fopen(filename, "rb");
-    if (!fp)
-        return false;
+    const bool patch = mode == GSDumpLoadMode::Patch;
 
-    // Read fake CRC
-    u32 fake_crc;
-    if (fread(&fake_crc, sizeof(u32), 1, fp) != 1 || fake_crc != 0xFFFFFFFF)
+    // Standard input is read front to back like a compressed dump
+    if (strcmp(filename, "-") == 0)
     {
-        fclose(fp);
+        if (patch)
+        {
+            fprintf(stderr, "Error: Standard input cannot be patched in place\n");
+            return false;
+        }
+        return m_stream.Open(filename) && DecodeVRAM();
+    }
+
+    int fd = open(filename, patch ? O_RDWR : O_RDONLY);
+    if (fd < 0)
         return false;
+
+    // Compressed dumps are decoded up to the end of VRAM and never mapped
+    u8 magic[6];
+    ssize_t magic_size = pread(fd, magic, sizeof(magic), 0);
+    if (DumpStream::DetectCompression(magic, magic_size > 0 ? static_cast<size_t>(magic_size) : 0) != DumpCompression::None)
+    {
+        close(fd);
+        if (patch)
+        {
+            fprintf(stderr, "Error: Compressed dumps cannot be patched in place: %s\n", filename);
+            return false;
+        }
+        return m_stream.Open(filename) && DecodeVRAM();
     }
 
-    // Read header size
-    u32 header_size;
-    if (fread(&header_size, sizeof(u32), 1, fp) != 1)
+    struct stat st;
+    u64 vram_offset;
+    if (fstat(fd, &st) != 0 || !ReadHeader(fd, &vram_offset))
     {
-        fclose(fp);
+        close(fd);
         return false;
     }
 
-    // Read GSDumpHeader
-    GSDumpHeader header;
-    if (fread(&header, sizeof(GSDumpHeader), 1, fp) != 1)
+    bool result;
+    if (patch)
     {
-        fclose(fp);
-        return false;
+        // Patching never grows the file, so all of VRAM must be there
+        result = static_cast<u64>(st.st_size) >= vram_offset + VRAM_SIZE;
+        if (!result)
+            fprintf(stderr, "Error: Dump is truncated, cannot patch VRAM: %s\n", filename);
+        else
+            result = MapVRAM(fd, static_cast<u64>(st.st_size), vram_offset, true);
     }
+    else if (mode == GSDumpLoadMode::Map)
+        result = MapVRAM(fd, static_cast<u64>(st.st_size), vram_offset, false) || ReadVRAM(fd, vram_offset);
+    else
+        result = ReadVRAM(fd, vram_offset);
+
+    close(fd);
+    return result;
+}
+
+bool GSDumpFile::ReadHeader(int fd, u64* vram_offset)
+{
+    // fake CRC (4) + header size (4) + GSDumpHeader
+    u8 data[8 + sizeof(GSDumpHeader)];
+    if (pread(fd, data, sizeof(data), 0) != static_cast<ssize_t>(sizeof(data)))
+        return false;
+
+    u32 fake_crc, header_size;
+    memcpy(&fake_crc, data + 0, sizeof(u32));
+    memcpy(&header_size, data + 4, sizeof(u32));
+    if (fake_crc != 0xFFFFFFFF)
+        return false;
 
-    // Calculate freezeData offset
     // freezeData starts after: fake_crc (4) + header_size_field (4) + header_size
-    u32 freeze_data_offset = 4 + 4 + header_size;
+    u64 freeze_data_offset = 4 + 4 + static_cast<u64>(header_size);
 
     // VRAM starts at freezeData + metadata
-    u32 vram_offset = freeze_data_offset + VRAM_METADATA_SIZE;
+    *vram_offset = freeze_data_offset + VRAM_METADATA_SIZE;
+    return true;
+}
+
+bool GSDumpFile::MapVRAM(int fd, u64 file_size, u64 vram_offset, bool writable)
+{
+    // mmap offsets must be page aligned, so map from the page holding the VRAM start
+    const u64 page_size = static_cast<u64>(sysconf(_SC_PAGESIZE));
+    const u64 map_offset = vram_offset & ~(page_size - 1);
+    const u64 delta = vram_offset - map_offset;
+    const size_t map_size = static_cast<size_t>((delta + VRAM_SIZE + page_size - 1) & ~(page_size - 1));
 
-    // Seek to VRAM
-    if (fseek(fp, vram_offset, SEEK_SET) != 0)
+    void* base;
+    if (file_size >= vram_offset + VRAM_SIZE)
     {
-        fclose(fp);
-        return false;
+        // Writable maps are shared so stores reach the file
+        base = mmap(nullptr, map_size, writable ? PROT_READ | PROT_WRITE : PROT_READ, writable ? MAP_SHARED : MAP_PRIVATE, fd, static_cast<off_t>(map_offset));
+        if (base == MAP_FAILED)
+            return false;
+    }
+    else
+    {
+        // Truncated file: reserve zeroed anonymous memory and map what the file
+        // has over the front of it, leaving only the missing tail zero-filled
+        base = mmap(nullptr, map_size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (base == MAP_FAILED)
+            return false;
+
+        if (file_size > map_offset)
+        {
+            size_t file_map_size = static_cast<size_t>((file_size - map_offset + page_size - 1) & ~(page_size - 1));
+            if (mmap(base, file_map_size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, static_cast<off_t>(map_offset)) == MAP_FAILED)
+            {
+                munmap(base, map_size);
+                return false;
+            }
+        }
     }
 
-    // Allocate and read VRAM
-    m_vram = (u8*)malloc(VRAM_SIZE);
-    if (!m_vram)
+    madvise(base, map_size, MADV_WILLNEED);
+
+    m_map = base;
+    m_mapSize = map_size;
+    m_writable = writable;
+    m_bytesRead = file_size > vram_offset ? std::min<u64>(file_size - vram_offset, VRAM_SIZE) : 0;
+    m_vram = static_cast<const u8*>(base) + delta;
+    return true;
+}
+
+bool GSDumpFile::ReadVRAM(int fd, u64 vram_offset)
+{
+    if (!m_buffer)
     {
-        fclose(fp);
-        return false;
+        m_buffer = static_cast<u8*>(AllocateBuffer(VRAM_SIZE));
+        if (!m_buffer)
+            return false;
+    }
+
+    size_t read = 0;
+    while (read < VRAM_SIZE)
+    {
+        ssize_t result = pread(fd, m_buffer + read, VRAM_SIZE - read, static_cast<off_t>(vram_offset + read));
+        if (result < 0)
+            return false;
+        if (result == 0)
+            break;
+        read += static_cast<size_t>(result);
     }
 
-    size_t read = fread(m_vram, 1, VRAM_SIZE, fp);
+    m_bytesRead = read;
     if (read < VRAM_SIZE)
     {
         // Pad with zeros if file is short
-        memset(m_vram + read, 0, VRAM_SIZE - read);
+        memset(m_buffer + read, 0, VRAM_SIZE - read);
     }
 
-    fclose(fp);
+    m_vram = m_buffer;
     return true;
 }
 
+bool GSDumpFile::Open(const void* data, size_t size)
+{
+    Close();
+
+    // Point straight into a complete raw dump
+    const u8* bytes = static_cast<const u8*>(data);
+    u32 fake_crc, header_size;
+    if (size >= 8 && DumpStream::DetectCompression(bytes, size) == DumpCompression::None)
+    {
+        memcpy(&fake_crc, bytes + 0, sizeof(u32));
+        memcpy(&header_size, bytes + 4, sizeof(u32));
+        if (fake_crc != 0xFFFFFFFF)
+            return false;
+
+        const u64 vram_offset = 8 + static_cast<u64>(header_size) + VRAM_METADATA_SIZE;
+        if (size >= vram_offset + VRAM_SIZE)
+        {
+            m_vram = bytes + vram_offset;
+            m_bytesRead = VRAM_SIZE;
+            return true;
+        }
+    }
+
+    // Compressed or short dumps are decoded into the read buffer
+    return m_stream.Open(data, size) && DecodeVRAM();
+}
+
+bool GSDumpFile::DecodeVRAM()
+{
+    if (!m_buffer)
+    {
+        m_buffer = static_cast<u8*>(AllocateBuffer(VRAM_SIZE));
+        if (!m_buffer)
+        {
+            m_stream.Close();
+            return false;
+        }
+    }
+
+    u32 fake_crc, header_size;
+    bool result = m_stream.Read(&fake_crc, sizeof(fake_crc)) == sizeof(fake_crc) &&
+        m_stream.Read(&header_size, sizeof(header_size)) == sizeof(header_size) &&
+        fake_crc == 0xFFFFFFFF &&
+        m_stream.Skip(static_cast<u64>(header_size) + VRAM_METADATA_SIZE);
+
+    if (result)
+    {
+        // Pad with zeros if the stream is short, as for raw files
+        size_t read = m_stream.Read(m_buffer, VRAM_SIZE);
+        if (read < VRAM_SIZE)
+            memset(m_buffer + read, 0, VRAM_SIZE - read);
+        m_vram = m_buffer;
+    }
+
+    // Nothing past VRAM is decoded
+    m_bytesRead = m_stream.GetBytesRead();
+    m_stream.Close();
+    return result;
+}
+
 void GSDumpFile::Close()
 {
-    if (m_vram)
+    if (m_map)
     {
-        free(m_vram);
-        m_vram = nullptr;
+        if (m_writable)
+            msync(m_map, m_mapSize, MS_SYNC);
+        munmap(m_map, m_mapSize);
+        m_map = nullptr;
+        m_mapSize = 0;
+        m_writable = false;
     }
+    m_vram = nullptr;
+    m_bytesRead = 0;
 }
@@ -0,0 +1,431 @@
+// GS dump packet stream replay implementation
+#include "gsreplay.h"
+#include "gsdump.h"
+#include "gsswizzle.h"
+
+// Packet ids and transfer paths as written by PCSX2
+enum GSPacketType : u8
+{
+    GS_PACKET_TRANSFER = 0,
+    GS_PACKET_VSYNC = 1,
+    GS_PACKET_READ_FIFO2 = 2,
+    GS_PACKET_REGISTERS = 3,
+};
+
+enum GSTransferPath : u8
+{
+    GS_PATH1_OLD = 0,
+    GS_PATH2 = 1,
+    GS_PATH3 = 2,
+    GS_PATH1_NEW = 3,
+};
+
+// GS registers written through A+D that drive image transfers
+enum GSTransferRegister : u32
+{
+    GS_BITBLTBUF = 0x50,
+    GS_TRXPOS = 0x51,
+    GS_TRXREG = 0x52,
+    GS_TRXDIR = 0x53,
+    GS_HWREG = 0x54,
+};
+
+// Transfer packets are parsed 64KB at a time
+static const size_t PACKET_CHUNK_SIZE = 64 * 1024;
+
+// Bits per pixel of transferred data (differs from storage for 24-bit and the H formats)
+static int GetTransferBits(u32 psm)
+{
+    switch (psm)
+    {
+    case PSMCT24: case PSMZ24: return 24;
+    case PSMCT16: case PSMCT16S: case PSMZ16: case PSMZ16S: return 16;
+    case PSMT8: case PSMT8H: return 8;
+    case PSMT4: case PSMT4HL: case PSMT4HH: return 4;
+    default: return 32;
+    }
+}
+
+GSReplayer::GSReplayer()
+    : m_bitbltbuf(0)
+    , m_trxpos(0)
+    , m_trxreg(0)
+    , m_frame(0)
+    , m_error(false)
+{
+}
+
+GSReplayer::~GSReplayer()
+{
+    Close();
+}
+
+bool GSReplayer::Open(const char* filename)
+{
+    Close();
+
+    if (!m_stream.Open(filename))
+        return false;
+
+    // fake CRC (4) + header size (4) + GSDumpHeader and whatever follows it
+    u32 fake_crc, header_size;
+    GSDumpHeader header;
+    if (!Read(&fake_crc, sizeof(fake_crc)) || !Read(&header_size, sizeof(header_size)) ||
+        fake_crc != 0xFFFFFFFF || header_size < sizeof(header) ||
+        !Read(&header, sizeof(header)) || !Skip(header_size - sizeof(header)))
+    {
+        Close();
+        return false;
+    }
+
+    // VRAM sits inside the freeze data; anything the state does not cover stays zero
+    m_vram.assign(VRAM_SIZE, 0);
+    u64 state_left = header.state_size;
+    if (state_left > VRAM_METADATA_SIZE)
+    {
+        const u64 vram_size = state_left - VRAM_METADATA_SIZE < VRAM_SIZE ? state_left - VRAM_METADATA_SIZE : VRAM_SIZE;
+        if (!Skip(VRAM_METADATA_SIZE) || !Read(m_vram.data(), static_cast<size_t>(vram_size)))
+        {
+            Close();
+            return false;
+        }
+        state_left -= VRAM_METADATA_SIZE + vram_size;
+    }
+
+    // Rest of the state, then the privileged registers
+    if (!Skip(state_left) || !Skip(REGISTERS_SIZE))
+    {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+void GSReplayer::Close()
+{
+    m_stream.Close();
+
+    for (GIFPath& path : m_paths)
+        path = GIFPath();
+    m_transfer = Transfer();
+    m_bitbltbuf = 0;
+    m_trxpos = 0;
+    m_trxreg = 0;
+    m_frame = 0;
+    m_error = false;
+}
+
+bool GSReplayer::Read(void* data, size_t size)
+{
+    return m_stream.Read(data, size) == size;
+}
+
+bool GSReplayer::Skip(u64 size)
+{
+    return m_stream.Skip(size);
+}
+
+bool GSReplayer::NextFrame()
+{
+    if (m_error)
+        return false;
+
+    for (;;)
+    {
+        u8 id;
+        if (!Read(&id, 1))
+        {
+            // End of the stream, unless decompression failed
+            m_error = m_stream.HasError();
+            return false;
+        }
+
+        switch (id)
+        {
+        case GS_PACKET_TRANSFER:
+        {
+            u8 path;
+            u32 size;
+            if (!Read(&path, 1) || !Read(&size, sizeof(size)))
+            {
+                m_error = true;
+                return false;
+            }
+
+            // Old PATH1 packets hold the tail of VU1 memory, which is parsed the same way
+            GIFPath* gif =
+                path == GS_PATH1_OLD || path == GS_PATH1_NEW ? &m_paths[0] :
+                path == GS_PATH2 ? &m_paths[1] :
+                path == GS_PATH3 ? &m_paths[2] : nullptr;
+            if (!gif)
+            {
+                if (!Skip(size))
+                {
+                    m_error = true;
+                    return false;
+                }
+                break;
+            }
+
+            // Stream large uploads through a fixed-size buffer
+            while (size > 0)
+            {
+                const size_t chunk = size < PACKET_CHUNK_SIZE ? size : PACKET_CHUNK_SIZE;
+                m_packet.resize(chunk);
+                if (!Read(m_packet.data(), chunk))
+                {
+                    m_error = true;
+                    return false;
+                }
+                ProcessGIF(*gif, m_packet.data(), chunk);
+                size -= static_cast<u32>(chunk);
+            }
+            break;
+        }
+
+        case GS_PACKET_VSYNC:
+            if (!Skip(1))
+            {
+                m_error = true;
+                return false;
+            }
+            m_frame++;
+            return true;
+
+        case GS_PACKET_READ_FIFO2:
+            if (!Skip(4))
+            {
+                m_error = true;
+                return false;
+            }
+            break;
+
+        case GS_PACKET_REGISTERS:
+            if (!Skip(REGISTERS_SIZE))
+            {
+                m_error = true;
+                return false;
+            }
+            break;
+
+        default:
+            m_error = true;
+            return false;
+        }
+    }
+}
+
+void GSReplayer::ProcessGIF(GIFPath& path, const u8* data, size_t size)
+{
+    // Finish a qword cut by the previous packet
+    if (path.partial_size > 0)
+    {
+        size_t count = 16 - path.partial_size < size ? 16 - path.partial_size : size;
+        memcpy(path.partial + path.partial_size, data, count);
+        path.partial_size += static_cast<u32>(count);
+        data += count;
+        size -= count;
+        if (path.partial_size < 16)
+            return;
+
+        path.partial_size = 0;
+        ProcessQword(path, path.partial);
+    }
+
+    for (; size >= 16; data += 16, size -= 16)
+        ProcessQword(path, data);
+
+    memcpy(path.partial, data, size);
+    path.partial_size = static_cast<u32>(size);
+}
+
+void GSReplayer::ProcessQword(GIFPath& path, const u8* qword)
+{
+    u64 lo, hi;
+    memcpy(&lo, qword, sizeof(lo));
+    memcpy(&hi, qword + 8, sizeof(hi));
+
+    if (path.nloop == 0)
+    {
+        // GIF tag: NLOOP, FLG, NREG and the register descriptors
+        path.nloop = static_cast<u32>(lo & 0x7FFF);
+        path.flg = static_cast<u32>(lo >> 58) & 3;
+        path.nreg = static_cast<u32>(lo >> 60);
+        if (path.nreg == 0)
+            path.nreg = 16;
+        path.regs = hi;
+        path.reg = 0;
+        return;
+    }
+
+    switch (path.flg)
+    {
+    case 0:
+        // PACKED: only A+D reaches the transfer registers
+        if (((path.regs >> (path.reg * 4)) & 0xF) == 0xE)
+            WriteRegister(static_cast<u32>(hi & 0xFF), lo);
+        if (++path.reg == path.nreg)
+        {
+            path.reg = 0;
+            path.nloop--;
+        }
+        break;
+
+    case 1:
+        // REGLIST: two 64-bit writes per qword, none of them to transfer registers
+        for (int half = 0; half < 2 && path.nloop > 0; half++)
+        {
+            if (++path.reg == path.nreg)
+            {
+                path.reg = 0;
+                path.nloop--;
+            }
+        }
+        break;
+
+    default:
+        // IMAGE: one qword of HOST->LOCAL data per loop
+        HostToLocal(qword, 16);
+        path.nloop--;
+        break;
+    }
+}
+
+void GSReplayer::WriteRegister(u32 addr, u64 value)
+{
+    switch (addr)
+    {
+    case GS_BITBLTBUF:
+        m_bitbltbuf = value;
+        break;
+
+    case GS_TRXPOS:
+        m_trxpos = value;
+        break;
+
+    case GS_TRXREG:
+        m_trxreg = value;
+        break;
+
+    case GS_TRXDIR:
+    {
+        // Writing TRXDIR starts the transfer set up by the other three
+        m_transfer = Transfer();
+        const u32 dir = static_cast<u32>(value & 3);
+        if (dir == 0)
+        {
+            m_transfer.bp = static_cast<u32>(m_bitbltbuf >> 32) & 0x3FFF;
+            m_transfer.bw = static_cast<u32>(m_bitbltbuf >> 48) & 0x3F;
+            m_transfer.psm = static_cast<u32>(m_bitbltbuf >> 56) & 0x3F;
+            m_transfer.x = static_cast<int>(m_trxpos >> 32) & 0x7FF;
+            m_transfer.y = static_cast<int>(m_trxpos >> 48) & 0x7FF;
+            m_transfer.width = static_cast<int>(m_trxreg) & 0xFFF;
+            m_transfer.height = static_cast<int>(m_trxreg >> 32) & 0xFFF;
+            m_transfer.active = IsValidPsm(m_transfer.psm) && m_transfer.width > 0 && m_transfer.height > 0;
+        }
+        else if (dir == 2)
+        {
+            LocalToLocal();
+        }
+        break;
+    }
+
+    case GS_HWREG:
+        HostToLocal(reinterpret_cast<const u8*>(&value), sizeof(value));
+        break;
+    }
+}
+
+void GSReplayer::HostToLocal(const u8* data, size_t size)
+{
+    Transfer& t = m_transfer;
+    if (!t.active)
+        return;
+
+    // Pixels are gathered into row runs and written with one call per run
+    m_row.clear();
+    auto emit = [&](u32 value)
+    {
+        m_row.push_back(value);
+        if (t.cx + static_cast<int>(m_row.size()) == t.width)
+        {
+            WritePixels(m_vram.data(), t.x + t.cx, t.y + t.cy, static_cast<int>(m_row.size()), t.bp, t.bw, t.psm, m_row.data());
+            m_row.clear();
+            t.cx = 0;
+            if (++t.cy == t.height)
+                t.active = false;
+        }
+    };
+
+    const u8* p = data;
+    const u8* end = data + size;
+    const int bits = GetTransferBits(t.psm);
+    if (bits == 4)
+    {
+        // Two pixels per byte, low nibble first
+        for (; p < end && t.active; p++)
+        {
+            emit(*p & 0xF);
+            if (t.active)
+                emit(*p >> 4);
+        }
+    }
+    else
+    {
+        // 24-bit pixels can straddle qwords
+        const u32 bytes = static_cast<u32>(bits / 8);
+        while (p < end && t.active)
+        {
+            const u8* pixel;
+            if (t.partial_size == 0 && static_cast<size_t>(end - p) >= bytes)
+            {
+                pixel = p;
+                p += bytes;
+            }
+            else
+            {
+                t.partial[t.partial_size++] = *p++;
+                if (t.partial_size < bytes)
+                    continue;
+                t.partial_size = 0;
+                pixel = t.partial;
+            }
+
+            u32 value = 0;
+            memcpy(&value, pixel, bytes);
+            emit(value);
+        }
+    }
+
+    if (!m_row.empty())
+    {
+        WritePixels(m_vram.data(), t.x + t.cx, t.y + t.cy, static_cast<int>(m_row.size()), t.bp, t.bw, t.psm, m_row.data());
+        t.cx += static_cast<int>(m_row.size());
+        m_row.clear();
+    }
+}
+
+void GSReplayer::LocalToLocal()
+{
+    const u32 sbp = static_cast<u32>(m_bitbltbuf) & 0x3FFF;
+    const u32 sbw = static_cast<u32>(m_bitbltbuf >> 16) & 0x3F;
+    const u32 spsm = static_cast<u32>(m_bitbltbuf >> 24) & 0x3F;
+    const u32 dbp = static_cast<u32>(m_bitbltbuf >> 32) & 0x3FFF;
+    const u32 dbw = static_cast<u32>(m_bitbltbuf >> 48) & 0x3F;
+    const u32 dpsm = static_cast<u32>(m_bitbltbuf >> 56) & 0x3F;
+    const int sx = static_cast<int>(m_trxpos) & 0x7FF;
+    const int sy = static_cast<int>(m_trxpos >> 16) & 0x7FF;
+    const int dx = static_cast<int>(m_trxpos >> 32) & 0x7FF;
+    const int dy = static_cast<int>(m_trxpos >> 48) & 0x7FF;
+    const int width = static_cast<int>(m_trxreg) & 0xFFF;
+    const int height = static_cast<int>(m_trxreg >> 32) & 0xFFF;
+    if (!IsValidPsm(spsm) || !IsValidPsm(dpsm) || width == 0 || height == 0)
+        return;
+
+    // Read the whole source first so overlapping rects copy as a snapshot
+    std::vector<u32> pixels(static_cast<size_t>(width) * height);
+    for (int y = 0; y < height; y++)
+        ReadPixels(m_vram.data(), sx, sy + y, width, sbp, sbw, spsm, pixels.data() + static_cast<size_t>(y) * width);
+    for (int y = 0; y < height; y++)
+        WritePixels(m_vram.data(), dx, dy + y, width, dbp, dbw, dpsm, pixels.data() + static_cast<size_t>(y) * width);
+}
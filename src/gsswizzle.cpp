@@ -1,6 +1,42 @@
 #include "gsswizzle.h"
+#include "threadpool.h"
 
-static const int blockTable32[32] =
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define GS_SWIZZLE_X86 1
+#include <immintrin.h>
+#endif
+
+// VRAM can sit at any byte offset (a mapped dump points into the file), so
+// words go through memcpy, which compiles to a plain move
+static inline u32 LoadU32(const u8* p)
+{
+    u32 value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline u16 LoadU16(const u8* p)
+{
+    u16 value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline void StoreU32(u8* p, u32 value)
+{
+    memcpy(p, &value, sizeof(value));
+}
+
+static inline void StoreU16(u8* p, u16 value)
+{
+    memcpy(p, &value, sizeof(value));
+}
+
+static constexpr int blockTable32[32] =
 {
      0,  1,  4,  5, 16, 17, 20, 21,
      2,  3,  6,  7, 18, 19, 22, 23,
@@ -8,38 +44,1122 @@ static const int blockTable32[32] =
     10, 11, 14, 15, 26, 27, 30, 31
 };
 
-static const int columnTable16[16] =
+static constexpr int columnTable16[16] =
 {
     0,  1,  4,  5,  8,  9, 12, 13,
     2,  3,  6,  7, 10, 11, 14, 15
 };
 
-u32 PixelAddress32(int x, int y, u32 bp, u32 bw)
+// Block order within a page and element order within a block for the other
+// storage formats (PSMT8 pages use blockTable32, PSMT4 pages blockTable16)
+
+static constexpr int blockTable32Z[32] =
 {
-    int pageX = x >> 6;
-    int pageY = y >> 5;
-    int pageIdx = pageY * bw + pageX;
+    24, 25, 28, 29,  8,  9, 12, 13,
+    26, 27, 30, 31, 10, 11, 14, 15,
+    16, 17, 20, 21,  0,  1,  4,  5,
+    18, 19, 22, 23,  2,  3,  6,  7
+};
 
-    int blockX = (x >> 3) & 7;
-    int blockY = (y >> 3) & 3;
-    int blockIdx = blockTable32[blockY * 8 + blockX];
+static constexpr int blockTable16[32] =
+{
+     0,  2,  8, 10,
+     1,  3,  9, 11,
+     4,  6, 12, 14,
+     5,  7, 13, 15,
+    16, 18, 24, 26,
+    17, 19, 25, 27,
+    20, 22, 28, 30,
+    21, 23, 29, 31
+};
 
-    int columnX = x & 7;
-    int columnY = y & 1;
-    int columnIdx = (y & 7) >> 1;
+static constexpr int blockTable16S[32] =
+{
+     0,  2, 16, 18,
+     1,  3, 17, 19,
+     8, 10, 24, 26,
+     9, 11, 25, 27,
+     4,  6, 20, 22,
+     5,  7, 21, 23,
+    12, 14, 28, 30,
+    13, 15, 29, 31
+};
 
-    int pixelOffset = columnTable16[columnY * 8 + columnX];
+static constexpr int blockTable16Z[32] =
+{
+    24, 26, 16, 18,
+    25, 27, 17, 19,
+    28, 30, 20, 22,
+    29, 31, 21, 23,
+     8, 10,  0,  2,
+     9, 11,  1,  3,
+    12, 14,  4,  6,
+    13, 15,  5,  7
+};
+
+static constexpr int blockTable16SZ[32] =
+{
+    24, 26,  8, 10,
+    25, 27,  9, 11,
+    16, 18,  0,  2,
+    17, 19,  1,  3,
+    28, 30, 12, 14,
+    29, 31, 13, 15,
+    20, 22,  4,  6,
+    21, 23,  5,  7
+};
 
-    int addr = pageIdx * 64 * 32;
-    addr += blockIdx * 8 * 8;
-    addr += columnIdx * 8 * 2;
-    addr += pixelOffset;
+static constexpr u16 columnTablePsm32[64] =
+{
+     0,  1,  4,  5,  8,  9, 12, 13,
+     2,  3,  6,  7, 10, 11, 14, 15,
+    16, 17, 20, 21, 24, 25, 28, 29,
+    18, 19, 22, 23, 26, 27, 30, 31,
+    32, 33, 36, 37, 40, 41, 44, 45,
+    34, 35, 38, 39, 42, 43, 46, 47,
+    48, 49, 52, 53, 56, 57, 60, 61,
+    50, 51, 54, 55, 58, 59, 62, 63
+};
 
-    return static_cast<u32>(addr);
+static constexpr u16 columnTablePsm16[128] =
+{
+      0,   2,   8,  10,  16,  18,  24,  26,   1,   3,   9,  11,  17,  19,  25,  27,
+      4,   6,  12,  14,  20,  22,  28,  30,   5,   7,  13,  15,  21,  23,  29,  31,
+     32,  34,  40,  42,  48,  50,  56,  58,  33,  35,  41,  43,  49,  51,  57,  59,
+     36,  38,  44,  46,  52,  54,  60,  62,  37,  39,  45,  47,  53,  55,  61,  63,
+     64,  66,  72,  74,  80,  82,  88,  90,  65,  67,  73,  75,  81,  83,  89,  91,
+     68,  70,  76,  78,  84,  86,  92,  94,  69,  71,  77,  79,  85,  87,  93,  95,
+     96,  98, 104, 106, 112, 114, 120, 122,  97,  99, 105, 107, 113, 115, 121, 123,
+    100, 102, 108, 110, 116, 118, 124, 126, 101, 103, 109, 111, 117, 119, 125, 127
+};
+
+static constexpr u16 columnTablePsm8[256] =
+{
+      0,   4,  16,  20,  32,  36,  48,  52,   2,   6,  18,  22,  34,  38,  50,  54,
+      8,  12,  24,  28,  40,  44,  56,  60,  10,  14,  26,  30,  42,  46,  58,  62,
+     33,  37,  49,  53,   1,   5,  17,  21,  35,  39,  51,  55,   3,   7,  19,  23,
+     41,  45,  57,  61,   9,  13,  25,  29,  43,  47,  59,  63,  11,  15,  27,  31,
+     96, 100, 112, 116,  64,  68,  80,  84,  98, 102, 114, 118,  66,  70,  82,  86,
+    104, 108, 120, 124,  72,  76,  88,  92, 106, 110, 122, 126,  74,  78,  90,  94,
+     65,  69,  81,  85,  97, 101, 113, 117,  67,  71,  83,  87,  99, 103, 115, 119,
+     73,  77,  89,  93, 105, 109, 121, 125,  75,  79,  91,  95, 107, 111, 123, 127,
+    128, 132, 144, 148, 160, 164, 176, 180, 130, 134, 146, 150, 162, 166, 178, 182,
+    136, 140, 152, 156, 168, 172, 184, 188, 138, 142, 154, 158, 170, 174, 186, 190,
+    161, 165, 177, 181, 129, 133, 145, 149, 163, 167, 179, 183, 131, 135, 147, 151,
+    169, 173, 185, 189, 137, 141, 153, 157, 171, 175, 187, 191, 139, 143, 155, 159,
+    224, 228, 240, 244, 192, 196, 208, 212, 226, 230, 242, 246, 194, 198, 210, 214,
+    232, 236, 248, 252, 200, 204, 216, 220, 234, 238, 250, 254, 202, 206, 218, 222,
+    193, 197, 209, 213, 225, 229, 241, 245, 195, 199, 211, 215, 227, 231, 243, 247,
+    201, 205, 217, 221, 233, 237, 249, 253, 203, 207, 219, 223, 235, 239, 251, 255
+};
+
+static constexpr u16 columnTablePsm4[512] =
+{
+      0,   8,  32,  40,  64,  72,  96, 104,   2,  10,  34,  42,  66,  74,  98, 106,
+      4,  12,  36,  44,  68,  76, 100, 108,   6,  14,  38,  46,  70,  78, 102, 110,
+     16,  24,  48,  56,  80,  88, 112, 120,  18,  26,  50,  58,  82,  90, 114, 122,
+     20,  28,  52,  60,  84,  92, 116, 124,  22,  30,  54,  62,  86,  94, 118, 126,
+     65,  73,  97, 105,   1,   9,  33,  41,  67,  75,  99, 107,   3,  11,  35,  43,
+     69,  77, 101, 109,   5,  13,  37,  45,  71,  79, 103, 111,   7,  15,  39,  47,
+     81,  89, 113, 121,  17,  25,  49,  57,  83,  91, 115, 123,  19,  27,  51,  59,
+     85,  93, 117, 125,  21,  29,  53,  61,  87,  95, 119, 127,  23,  31,  55,  63,
+    192, 200, 224, 232, 128, 136, 160, 168, 194, 202, 226, 234, 130, 138, 162, 170,
+    196, 204, 228, 236, 132, 140, 164, 172, 198, 206, 230, 238, 134, 142, 166, 174,
+    208, 216, 240, 248, 144, 152, 176, 184, 210, 218, 242, 250, 146, 154, 178, 186,
+    212, 220, 244, 252, 148, 156, 180, 188, 214, 222, 246, 254, 150, 158, 182, 190,
+    129, 137, 161, 169, 193, 201, 225, 233, 131, 139, 163, 171, 195, 203, 227, 235,
+    133, 141, 165, 173, 197, 205, 229, 237, 135, 143, 167, 175, 199, 207, 231, 239,
+    145, 153, 177, 185, 209, 217, 241, 249, 147, 155, 179, 187, 211, 219, 243, 251,
+    149, 157, 181, 189, 213, 221, 245, 253, 151, 159, 183, 191, 215, 223, 247, 255,
+    256, 264, 288, 296, 320, 328, 352, 360, 258, 266, 290, 298, 322, 330, 354, 362,
+    260, 268, 292, 300, 324, 332, 356, 364, 262, 270, 294, 302, 326, 334, 358, 366,
+    272, 280, 304, 312, 336, 344, 368, 376, 274, 282, 306, 314, 338, 346, 370, 378,
+    276, 284, 308, 316, 340, 348, 372, 380, 278, 286, 310, 318, 342, 350, 374, 382,
+    321, 329, 353, 361, 257, 265, 289, 297, 323, 331, 355, 363, 259, 267, 291, 299,
+    325, 333, 357, 365, 261, 269, 293, 301, 327, 335, 359, 367, 263, 271, 295, 303,
+    337, 345, 369, 377, 273, 281, 305, 313, 339, 347, 371, 379, 275, 283, 307, 315,
+    341, 349, 373, 381, 277, 285, 309, 317, 343, 351, 375, 383, 279, 287, 311, 319,
+    448, 456, 480, 488, 384, 392, 416, 424, 450, 458, 482, 490, 386, 394, 418, 426,
+    452, 460, 484, 492, 388, 396, 420, 428, 454, 462, 486, 494, 390, 398, 422, 430,
+    464, 472, 496, 504, 400, 408, 432, 440, 466, 474, 498, 506, 402, 410, 434, 442,
+    468, 476, 500, 508, 404, 412, 436, 444, 470, 478, 502, 510, 406, 414, 438, 446,
+    385, 393, 417, 425, 449, 457, 481, 489, 387, 395, 419, 427, 451, 459, 483, 491,
+    389, 397, 421, 429, 453, 461, 485, 493, 391, 399, 423, 431, 455, 463, 487, 495,
+    401, 409, 433, 441, 465, 473, 497, 505, 403, 411, 435, 443, 467, 475, 499, 507,
+    405, 413, 437, 445, 469, 477, 501, 509, 407, 415, 439, 447, 471, 479, 503, 511
+};
+
+// Storage bits, page size and block size (as log2 of the pixel counts)
+#define PSM_32 32, 6, 5, 3, 3
+#define PSM_16 16, 6, 6, 4, 3
+#define PSM_8   8, 7, 6, 4, 4
+#define PSM_4   4, 7, 7, 5, 4
+
+// Element offset of every pixel of a page from the start of the page, row by
+// row, combining the block and column tables. Generated at compile time.
+template <int Bits, int PageShiftX, int PageShiftY, int BlockShiftX, int BlockShiftY>
+struct PageTable
+{
+    u16 offsets[1 << (PageShiftX + PageShiftY)];
+};
+
+template <int Bits, int PageShiftX, int PageShiftY, int BlockShiftX, int BlockShiftY>
+static constexpr PageTable<Bits, PageShiftX, PageShiftY, BlockShiftX, BlockShiftY> MakePageTable(const int* block_table, const u16* column_table)
+{
+    PageTable<Bits, PageShiftX, PageShiftY, BlockShiftX, BlockShiftY> table = {};
+    const int blocks_per_row = 1 << (PageShiftX - BlockShiftX);
+    for (int y = 0; y < 1 << PageShiftY; y++)
+    {
+        for (int x = 0; x < 1 << PageShiftX; x++)
+        {
+            const int block = block_table[(y >> BlockShiftY) * blocks_per_row + (x >> BlockShiftX)];
+            const int column = column_table[((y & ((1 << BlockShiftY) - 1)) << BlockShiftX) + (x & ((1 << BlockShiftX) - 1))];
+            table.offsets[(y << PageShiftX) + x] = static_cast<u16>((block << (BlockShiftX + BlockShiftY)) + column);
+        }
+    }
+    return table;
+}
+
+static constexpr auto pageTable32   = MakePageTable<PSM_32>(blockTable32,   columnTablePsm32);
+static constexpr auto pageTable32Z  = MakePageTable<PSM_32>(blockTable32Z,  columnTablePsm32);
+static constexpr auto pageTable16   = MakePageTable<PSM_16>(blockTable16,   columnTablePsm16);
+static constexpr auto pageTable16S  = MakePageTable<PSM_16>(blockTable16S,  columnTablePsm16);
+static constexpr auto pageTable16Z  = MakePageTable<PSM_16>(blockTable16Z,  columnTablePsm16);
+static constexpr auto pageTable16SZ = MakePageTable<PSM_16>(blockTable16SZ, columnTablePsm16);
+static constexpr auto pageTable8    = MakePageTable<PSM_8>(blockTable32,    columnTablePsm8);
+static constexpr auto pageTable4    = MakePageTable<PSM_4>(blockTable16,    columnTablePsm4);
+
+static_assert(pageTable32.offsets[1] == 1 && pageTable32.offsets[64] == 2 && pageTable32.offsets[8] == 64, "PSMCT32 page table");
+static_assert(pageTable4.offsets[128 * 128 - 1] == 32 * 512 - 1, "PSMT4 page table");
+
+// GS local memory wraps at 4MB (16K blocks of 64 32-bit words)
+static const u32 vramBlockMask = 0x3FFF;
+
+u32 PixelAddress32(int x, int y, u32 bp, u32 bw)
+{
+    // A page is 32 blocks of 64 words; adding the in-page offset before
+    // masking wraps exactly like wrapping the block number
+    const u32 page = bp + ((y >> 5) * bw + (x >> 6)) * 32;
+    return (page * 64 + pageTable32.offsets[((y & 31) << 6) + (x & 63)]) & (vramBlockMask * 64 + 63);
 }
 
 u32 ReadPixel32(const u8* vram, int x, int y, u32 bp, u32 bw)
 {
-    const u32* vram32 = reinterpret_cast<const u32*>(vram);
-    return vram32[PixelAddress32(x, y, bp, bw)];
+    return LoadU32(vram + PixelAddress32(x, y, bp, bw) * 4);
+}
+
+// Block kernels
+//
+// A PSMCT32 block is 8x8 pixels stored as four 16-pixel columns. Each column
+// covers two rows and interleaves them in pairs of pixels (see columnTable16):
+//   r0x0 r0x1 r1x0 r1x1 r0x2 r0x3 r1x2 r1x3 ... r1x6 r1x7
+// so every column is deswizzled by splitting 64-bit pairs into its two rows,
+// and swizzled by interleaving the pairs of two rows again.
+
+// Blocks are addressed in bytes since VRAM need not be word aligned; a column is 64 bytes
+typedef void (*BlockKernel32)(const u8* src, u8* dst, size_t stride, u32 mask, u32 alpha);
+typedef void (*SwizzleKernel32)(const u8* src, u8* dst, size_t stride);
+
+static void DeswizzleBlock32_Scalar(const u8* src, u8* dst, size_t stride, u32 mask, u32 alpha)
+{
+    for (int y = 0; y < 8; y++)
+    {
+        const u8* column = src + (y >> 1) * 64;
+        const int* offsets = columnTable16 + (y & 1) * 8;
+        u8* row = dst + y * stride;
+
+        for (int x = 0; x < 8; x++)
+            StoreU32(row + x * 4, (LoadU32(column + offsets[x] * 4) & mask) | alpha);
+    }
+}
+
+static void SwizzleBlock32_Scalar(const u8* src, u8* dst, size_t stride)
+{
+    for (int y = 0; y < 8; y++)
+    {
+        u8* column = dst + (y >> 1) * 64;
+        const int* offsets = columnTable16 + (y & 1) * 8;
+        const u8* row = src + y * stride;
+
+        for (int x = 0; x < 8; x++)
+            StoreU32(column + offsets[x] * 4, LoadU32(row + x * 4));
+    }
+}
+
+#ifdef GS_SWIZZLE_X86
+
+__attribute__((target("sse2")))
+static void DeswizzleBlock32_SSE2(const u8* src, u8* dst, size_t stride, u32 mask, u32 alpha)
+{
+    const __m128i m = _mm_set1_epi32(static_cast<int>(mask));
+    const __m128i a = _mm_set1_epi32(static_cast<int>(alpha));
+
+    for (int c = 0; c < 4; c++)
+    {
+        const __m128i* column = reinterpret_cast<const __m128i*>(src + c * 64);
+        __m128i v0 = _mm_and_si128(_mm_loadu_si128(column + 0), m);
+        __m128i v1 = _mm_and_si128(_mm_loadu_si128(column + 1), m);
+        __m128i v2 = _mm_and_si128(_mm_loadu_si128(column + 2), m);
+        __m128i v3 = _mm_and_si128(_mm_loadu_si128(column + 3), m);
+
+        __m128i* row0 = reinterpret_cast<__m128i*>(dst + (c * 2 + 0) * stride);
+        __m128i* row1 = reinterpret_cast<__m128i*>(dst + (c * 2 + 1) * stride);
+
+        _mm_storeu_si128(row0 + 0, _mm_or_si128(_mm_unpacklo_epi64(v0, v1), a));
+        _mm_storeu_si128(row0 + 1, _mm_or_si128(_mm_unpacklo_epi64(v2, v3), a));
+        _mm_storeu_si128(row1 + 0, _mm_or_si128(_mm_unpackhi_epi64(v0, v1), a));
+        _mm_storeu_si128(row1 + 1, _mm_or_si128(_mm_unpackhi_epi64(v2, v3), a));
+    }
+}
+
+__attribute__((target("sse2")))
+static void SwizzleBlock32_SSE2(const u8* src, u8* dst, size_t stride)
+{
+    for (int c = 0; c < 4; c++)
+    {
+        const __m128i* row0 = reinterpret_cast<const __m128i*>(src + (c * 2 + 0) * stride);
+        const __m128i* row1 = reinterpret_cast<const __m128i*>(src + (c * 2 + 1) * stride);
+        __m128i r0a = _mm_loadu_si128(row0 + 0);
+        __m128i r0b = _mm_loadu_si128(row0 + 1);
+        __m128i r1a = _mm_loadu_si128(row1 + 0);
+        __m128i r1b = _mm_loadu_si128(row1 + 1);
+
+        __m128i* column = reinterpret_cast<__m128i*>(dst + c * 64);
+        _mm_storeu_si128(column + 0, _mm_unpacklo_epi64(r0a, r1a));
+        _mm_storeu_si128(column + 1, _mm_unpackhi_epi64(r0a, r1a));
+        _mm_storeu_si128(column + 2, _mm_unpacklo_epi64(r0b, r1b));
+        _mm_storeu_si128(column + 3, _mm_unpackhi_epi64(r0b, r1b));
+    }
+}
+
+__attribute__((target("avx2")))
+static void DeswizzleBlock32_AVX2(const u8* src, u8* dst, size_t stride, u32 mask, u32 alpha)
+{
+    const __m256i m = _mm256_set1_epi32(static_cast<int>(mask));
+    const __m256i a = _mm256_set1_epi32(static_cast<int>(alpha));
+
+    for (int c = 0; c < 4; c++)
+    {
+        const __m256i* column = reinterpret_cast<const __m256i*>(src + c * 64);
+        __m256i v0 = _mm256_and_si256(_mm256_loadu_si256(column + 0), m);
+        __m256i v1 = _mm256_and_si256(_mm256_loadu_si256(column + 1), m);
+
+        // Per 128-bit lane this yields pairs 0,2 / 1,3 of each row; fix up across lanes
+        __m256i r0 = _mm256_permute4x64_epi64(_mm256_unpacklo_epi64(v0, v1), 0xD8);
+        __m256i r1 = _mm256_permute4x64_epi64(_mm256_unpackhi_epi64(v0, v1), 0xD8);
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + (c * 2 + 0) * stride), _mm256_or_si256(r0, a));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + (c * 2 + 1) * stride), _mm256_or_si256(r1, a));
+    }
+}
+
+__attribute__((target("avx2")))
+static void SwizzleBlock32_AVX2(const u8* src, u8* dst, size_t stride)
+{
+    for (int c = 0; c < 4; c++)
+    {
+        // Order the pairs 0,2 / 1,3 so in-lane unpacks produce whole columns
+        __m256i r0 = _mm256_permute4x64_epi64(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + (c * 2 + 0) * stride)), 0xD8);
+        __m256i r1 = _mm256_permute4x64_epi64(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + (c * 2 + 1) * stride)), 0xD8);
+
+        __m256i* column = reinterpret_cast<__m256i*>(dst + c * 64);
+        _mm256_storeu_si256(column + 0, _mm256_unpacklo_epi64(r0, r1));
+        _mm256_storeu_si256(column + 1, _mm256_unpackhi_epi64(r0, r1));
+    }
+}
+
+#endif
+
+struct BlockKernelEntry
+{
+    BlockKernel32 kernel;
+    SwizzleKernel32 swizzle;
+    const char* name;
+};
+
+static BlockKernelEntry SelectBlockKernel32()
+{
+#ifdef GS_SWIZZLE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return { DeswizzleBlock32_AVX2, SwizzleBlock32_AVX2, "avx2" };
+    if (__builtin_cpu_supports("sse2"))
+        return { DeswizzleBlock32_SSE2, SwizzleBlock32_SSE2, "sse2" };
+#endif
+    return { DeswizzleBlock32_Scalar, SwizzleBlock32_Scalar, "scalar" };
+}
+
+static const BlockKernelEntry& GetBlockKernel32()
+{
+    static const BlockKernelEntry entry = SelectBlockKernel32();
+    return entry;
+}
+
+const char* GetDeswizzleKernelName()
+{
+    return GetBlockKernel32().name;
+}
+
+// Generic block engine
+//
+// Every format is described by its page and block geometry, a block table and
+// a column table mapping each pixel of a block to its element (word, halfword,
+// byte or nibble). Whole blocks go through a kernel with the geometry fixed at
+// compile time; blocks on the edge of a rect are read pixel by pixel. Writing
+// mirrors reading with a swizzler and an element writer per format.
+
+enum class PsmElement
+{
+    Color32,    // PSMCT32, PSMZ32
+    Color24,    // PSMCT24, PSMZ24
+    Color16,    // PSMCT16(S), PSMZ16(S)
+    Index8,     // PSMT8
+    Index4,     // PSMT4
+    Index8H,    // PSMT8H: bits 24-31 of a 32-bit word
+    Index4HL,   // PSMT4HL: bits 24-27
+    Index4HH,   // PSMT4HH: bits 28-31
+};
+
+// How elements turn into RGBA
+struct PixelConverter
+{
+    u32 mask;               // Color32/24: bits kept from VRAM
+    u32 alpha;              // Color32/24: bits OR'd in
+    u32 alpha16[2];         // Color16: alpha for A = 0 / A = 1
+    const u32* palette;     // Index formats
+};
+
+typedef void (*BlockKernel)(const u8* block, u8* dst, size_t stride, const PixelConverter& conv);
+typedef u32 (*ElementReader)(const u8* block, u32 index, const PixelConverter& conv);
+typedef void (*BlockSwizzler)(u8* block, const u8* src, size_t stride);
+typedef void (*ElementWriter)(u8* block, u32 index, const u8* src);
+
+struct PsmInfo
+{
+    u32 psm;
+    const char* name;
+    PsmElement element;
+    int bits;               // Storage bits per pixel
+    int pageShiftX;         // log2 of the page size in pixels
+    int pageShiftY;
+    int blockShiftX;        // log2 of the block size in pixels
+    int blockShiftY;
+    const int* blockTable;
+    const u16* columnTable;
+    const u16* pageTable;   // Element offsets within a page, from MakePageTable
+    BlockKernel kernel;
+    ElementReader reader;
+    BlockSwizzler swizzler;     // Source pixels are RGBA for color formats, index bytes otherwise
+    ElementWriter writer;
+};
+
+// CLUT index held by an element of an index format
+template <PsmElement E>
+static inline u32 ReadIndex(const u8* block, u32 index)
+{
+    switch (E)
+    {
+    case PsmElement::Index8:
+        return block[index];
+
+    case PsmElement::Index4:
+        return (block[index >> 1] >> ((index & 1) * 4)) & 0xF;
+
+    case PsmElement::Index8H:
+        return LoadU32(block + index * 4) >> 24;
+
+    case PsmElement::Index4HL:
+        return (LoadU32(block + index * 4) >> 24) & 0xF;
+
+    case PsmElement::Index4HH:
+        return LoadU32(block + index * 4) >> 28;
+
+    default:
+        return 0;
+    }
+}
+
+template <PsmElement E>
+static inline u32 ReadElement(const u8* block, u32 index, const PixelConverter& conv)
+{
+    switch (E)
+    {
+    case PsmElement::Color32:
+    case PsmElement::Color24:
+        return (LoadU32(block + index * 4) & conv.mask) | conv.alpha;
+
+    case PsmElement::Color16:
+    {
+        // ABGR1555, 5-bit channels widened by repeating their top bits
+        u32 v = LoadU16(block + index * 2);
+        u32 r = (v >> 0) & 0x1F;
+        u32 g = (v >> 5) & 0x1F;
+        u32 b = (v >> 10) & 0x1F;
+        r = (r << 3) | (r >> 2);
+        g = (g << 3) | (g >> 2);
+        b = (b << 3) | (b >> 2);
+        return r | (g << 8) | (b << 16) | conv.alpha16[v >> 15];
+    }
+
+    default:
+        return conv.palette[ReadIndex<E>(block, index)];
+    }
+}
+
+template <PsmElement E>
+static u32 ReadElementFn(const u8* block, u32 index, const PixelConverter& conv)
+{
+    return ReadElement<E>(block, index, conv);
+}
+
+// Bytes per source pixel when writing: RGBA for color formats, an index byte otherwise
+template <PsmElement E>
+static constexpr int GetSourceSize()
+{
+    return E >= PsmElement::Index8 ? 1 : 4;
+}
+
+// Raw element value of a source pixel. 16-bit color keeps the top 5 bits of
+// each channel and sets A when alpha is 0x80 or more, inverting ReadElement.
+template <PsmElement E>
+static inline u32 GetSourceValue(const u8* src)
+{
+    if (E >= PsmElement::Index8)
+        return *src;
+
+    const u32 rgba = LoadU32(src);
+    if (E != PsmElement::Color16)
+        return rgba;
+
+    return ((rgba >> 3) & 0x1F) | (((rgba >> 11) & 0x1F) << 5) | (((rgba >> 19) & 0x1F) << 10) | ((rgba >> 31) << 15);
+}
+
+// Store a raw value; formats sharing a word with others only replace their own bits
+template <PsmElement E>
+static inline void WriteElement(u8* block, u32 index, u32 value)
+{
+    u8* word = block + index * 4;
+    switch (E)
+    {
+    case PsmElement::Color32:  StoreU32(word, value); break;
+    case PsmElement::Color24:  StoreU32(word, (LoadU32(word) & 0xFF000000) | (value & 0x00FFFFFF)); break;
+    case PsmElement::Color16:  StoreU16(block + index * 2, static_cast<u16>(value)); break;
+    case PsmElement::Index8:   block[index] = static_cast<u8>(value); break;
+    case PsmElement::Index4:
+    {
+        const int shift = (index & 1) * 4;
+        block[index >> 1] = static_cast<u8>((block[index >> 1] & ~(0xF << shift)) | ((value & 0xF) << shift));
+        break;
+    }
+    case PsmElement::Index8H:  StoreU32(word, (LoadU32(word) & 0x00FFFFFF) | (value << 24)); break;
+    case PsmElement::Index4HL: StoreU32(word, (LoadU32(word) & 0xF0FFFFFF) | ((value & 0xF) << 24)); break;
+    case PsmElement::Index4HH: StoreU32(word, (LoadU32(word) & 0x0FFFFFFF) | ((value & 0xF) << 28)); break;
+    }
+}
+
+template <PsmElement E>
+static void WriteElementFn(u8* block, u32 index, const u8* src)
+{
+    WriteElement<E>(block, index, GetSourceValue<E>(src));
+}
+
+template <int BlockWidth, int BlockHeight>
+static inline const u16* GetColumnTable()
+{
+    return BlockHeight == 16 && BlockWidth == 32 ? columnTablePsm4 :
+           BlockHeight == 16 ? columnTablePsm8 :
+           BlockWidth == 16 ? columnTablePsm16 : columnTablePsm32;
+}
+
+// Column table walk with the block size known at compile time
+template <PsmElement E, int BlockWidth, int BlockHeight>
+static void DeswizzleBlockLUT(const u8* block, u8* dst, size_t stride, const PixelConverter& conv)
+{
+    const u16* column = GetColumnTable<BlockWidth, BlockHeight>();
+    for (int y = 0; y < BlockHeight; y++, column += BlockWidth)
+    {
+        u8* row = dst + y * stride;
+        for (int x = 0; x < BlockWidth; x++)
+            StoreU32(row + x * 4, ReadElement<E>(block, column[x], conv));
+    }
+}
+
+// 32-bit color blocks use the SIMD kernels
+static void DeswizzleBlockColor32(const u8* block, u8* dst, size_t stride, const PixelConverter& conv)
+{
+    GetBlockKernel32().kernel(block, dst, stride, conv.mask, conv.alpha);
+}
+
+// The inverse walk, from source pixels into a block
+template <PsmElement E, int BlockWidth, int BlockHeight>
+static void SwizzleBlockLUT(u8* block, const u8* src, size_t stride)
+{
+    const u16* column = GetColumnTable<BlockWidth, BlockHeight>();
+    for (int y = 0; y < BlockHeight; y++, column += BlockWidth)
+    {
+        const u8* row = src + y * stride;
+        for (int x = 0; x < BlockWidth; x++)
+            WriteElement<E>(block, column[x], GetSourceValue<E>(row + x * GetSourceSize<E>()));
+    }
+}
+
+static void SwizzleBlockColor32(u8* block, const u8* src, size_t stride)
+{
+    GetBlockKernel32().swizzle(src, block, stride);
+}
+
+// Same walk for index formats, writing one index byte per pixel
+template <PsmElement E, int BlockWidth, int BlockHeight>
+static void ExtractIndexBlockLUT(const u8* block, u8* dst, size_t stride)
+{
+    const u16* column = GetColumnTable<BlockWidth, BlockHeight>();
+    for (int y = 0; y < BlockHeight; y++, column += BlockWidth)
+    {
+        u8* row = dst + y * stride;
+        for (int x = 0; x < BlockWidth; x++)
+            row[x] = static_cast<u8>(ReadIndex<E>(block, column[x]));
+    }
+}
+
+static const PsmInfo psmInfos[] =
+{
+    { PSMCT32,  "PSMCT32",  PsmElement::Color32,  PSM_32, blockTable32,   columnTablePsm32, pageTable32.offsets,   DeswizzleBlockColor32, ReadElementFn<PsmElement::Color32>,
+      SwizzleBlockColor32, WriteElementFn<PsmElement::Color32> },
+    { PSMCT24,  "PSMCT24",  PsmElement::Color24,  PSM_32, blockTable32,   columnTablePsm32, pageTable32.offsets,   DeswizzleBlockColor32, ReadElementFn<PsmElement::Color24>,
+      SwizzleBlockLUT<PsmElement::Color24, 8, 8>, WriteElementFn<PsmElement::Color24> },
+    { PSMCT16,  "PSMCT16",  PsmElement::Color16,  PSM_16, blockTable16,   columnTablePsm16, pageTable16.offsets,   DeswizzleBlockLUT<PsmElement::Color16, 16, 8>, ReadElementFn<PsmElement::Color16>,
+      SwizzleBlockLUT<PsmElement::Color16, 16, 8>, WriteElementFn<PsmElement::Color16> },
+    { PSMCT16S, "PSMCT16S", PsmElement::Color16,  PSM_16, blockTable16S,  columnTablePsm16, pageTable16S.offsets,  DeswizzleBlockLUT<PsmElement::Color16, 16, 8>, ReadElementFn<PsmElement::Color16>,
+      SwizzleBlockLUT<PsmElement::Color16, 16, 8>, WriteElementFn<PsmElement::Color16> },
+    { PSMT8,    "PSMT8",    PsmElement::Index8,   PSM_8,  blockTable32,   columnTablePsm8,  pageTable8.offsets,    DeswizzleBlockLUT<PsmElement::Index8, 16, 16>, ReadElementFn<PsmElement::Index8>,
+      SwizzleBlockLUT<PsmElement::Index8, 16, 16>, WriteElementFn<PsmElement::Index8> },
+    { PSMT4,    "PSMT4",    PsmElement::Index4,   PSM_4,  blockTable16,   columnTablePsm4,  pageTable4.offsets,    DeswizzleBlockLUT<PsmElement::Index4, 32, 16>, ReadElementFn<PsmElement::Index4>,
+      SwizzleBlockLUT<PsmElement::Index4, 32, 16>, WriteElementFn<PsmElement::Index4> },
+    { PSMT8H,   "PSMT8H",   PsmElement::Index8H,  PSM_32, blockTable32,   columnTablePsm32, pageTable32.offsets,   DeswizzleBlockLUT<PsmElement::Index8H, 8, 8>, ReadElementFn<PsmElement::Index8H>,
+      SwizzleBlockLUT<PsmElement::Index8H, 8, 8>, WriteElementFn<PsmElement::Index8H> },
+    { PSMT4HL,  "PSMT4HL",  PsmElement::Index4HL, PSM_32, blockTable32,   columnTablePsm32, pageTable32.offsets,   DeswizzleBlockLUT<PsmElement::Index4HL, 8, 8>, ReadElementFn<PsmElement::Index4HL>,
+      SwizzleBlockLUT<PsmElement::Index4HL, 8, 8>, WriteElementFn<PsmElement::Index4HL> },
+    { PSMT4HH,  "PSMT4HH",  PsmElement::Index4HH, PSM_32, blockTable32,   columnTablePsm32, pageTable32.offsets,   DeswizzleBlockLUT<PsmElement::Index4HH, 8, 8>, ReadElementFn<PsmElement::Index4HH>,
+      SwizzleBlockLUT<PsmElement::Index4HH, 8, 8>, WriteElementFn<PsmElement::Index4HH> },
+    { PSMZ32,   "PSMZ32",   PsmElement::Color32,  PSM_32, blockTable32Z,  columnTablePsm32, pageTable32Z.offsets,  DeswizzleBlockColor32, ReadElementFn<PsmElement::Color32>,
+      SwizzleBlockColor32, WriteElementFn<PsmElement::Color32> },
+    { PSMZ24,   "PSMZ24",   PsmElement::Color24,  PSM_32, blockTable32Z,  columnTablePsm32, pageTable32Z.offsets,  DeswizzleBlockColor32, ReadElementFn<PsmElement::Color24>,
+      SwizzleBlockLUT<PsmElement::Color24, 8, 8>, WriteElementFn<PsmElement::Color24> },
+    { PSMZ16,   "PSMZ16",   PsmElement::Color16,  PSM_16, blockTable16Z,  columnTablePsm16, pageTable16Z.offsets,  DeswizzleBlockLUT<PsmElement::Color16, 16, 8>, ReadElementFn<PsmElement::Color16>,
+      SwizzleBlockLUT<PsmElement::Color16, 16, 8>, WriteElementFn<PsmElement::Color16> },
+    { PSMZ16S,  "PSMZ16S",  PsmElement::Color16,  PSM_16, blockTable16SZ, columnTablePsm16, pageTable16SZ.offsets, DeswizzleBlockLUT<PsmElement::Color16, 16, 8>, ReadElementFn<PsmElement::Color16>,
+      SwizzleBlockLUT<PsmElement::Color16, 16, 8>, WriteElementFn<PsmElement::Color16> },
+};
+
+#undef PSM_32
+#undef PSM_16
+#undef PSM_8
+#undef PSM_4
+
+static const PsmInfo* FindPsmInfo(u32 psm)
+{
+    for (const PsmInfo& info : psmInfos)
+    {
+        if (info.psm == psm)
+            return &info;
+    }
+    return nullptr;
+}
+
+bool IsValidPsm(u32 psm)
+{
+    return FindPsmInfo(psm) != nullptr;
+}
+
+const char* GetPsmName(u32 psm)
+{
+    const PsmInfo* info = FindPsmInfo(psm);
+    return info ? info->name : "unknown";
+}
+
+bool FindPsm(const char* name, u32* psm)
+{
+    // Accept "PSMT8", "t8" (any case) or the register value
+    for (const PsmInfo& info : psmInfos)
+    {
+        if (strcasecmp(name, info.name) == 0 || strcasecmp(name, info.name + 3) == 0)
+        {
+            *psm = info.psm;
+            return true;
+        }
+    }
+
+    char* end;
+    unsigned long value = strtoul(name, &end, 0);
+    if (*name != '\0' && *end == '\0' && IsValidPsm(static_cast<u32>(value)))
+    {
+        *psm = static_cast<u32>(value);
+        return true;
+    }
+    return false;
+}
+
+int GetPsmBitsPerPixel(u32 psm)
+{
+    const PsmInfo* info = FindPsmInfo(psm);
+    return info ? info->bits : 0;
+}
+
+int GetPsmPageWidth(u32 psm)
+{
+    const PsmInfo* info = FindPsmInfo(psm);
+    return info ? 1 << info->pageShiftX : 0;
+}
+
+int GetPsmPageHeight(u32 psm)
+{
+    const PsmInfo* info = FindPsmInfo(psm);
+    return info ? 1 << info->pageShiftY : 0;
+}
+
+bool IsIndexedPsm(u32 psm)
+{
+    const PsmInfo* info = FindPsmInfo(psm);
+    return info && info->element >= PsmElement::Index8;
+}
+
+// Byte address of the block holding (x, y); 128-pixel-wide pages count as two bw units
+static inline u32 BlockAddress(const PsmInfo& info, int x, int y, u32 bp, u32 bw)
+{
+    u32 pages_per_row = bw >> (info.pageShiftX - 6);
+    int pageIdx = (y >> info.pageShiftY) * pages_per_row + (x >> info.pageShiftX);
+
+    int blocksPerRow = 1 << (info.pageShiftX - info.blockShiftX);
+    int blockX = (x & ((1 << info.pageShiftX) - 1)) >> info.blockShiftX;
+    int blockY = (y & ((1 << info.pageShiftY) - 1)) >> info.blockShiftY;
+    int blockIdx = info.blockTable[blockY * blocksPerRow + blockX];
+
+    u32 block = bp + pageIdx * 32 + blockIdx;
+    return (block & vramBlockMask) * 256;
+}
+
+static inline u32 BlockElement(const PsmInfo& info, int x, int y)
+{
+    int bx = x & ((1 << info.blockShiftX) - 1);
+    int by = y & ((1 << info.blockShiftY) - 1);
+    return info.columnTable[(by << info.blockShiftX) + bx];
+}
+
+// Element address of the page holding (x, y), before wrapping; see PageElementMask
+static inline u32 PageElementBase(const PsmInfo& info, int x, int y, u32 bp, u32 bw)
+{
+    u32 pages_per_row = bw >> (info.pageShiftX - 6);
+    u32 pageIdx = (y >> info.pageShiftY) * pages_per_row + (x >> info.pageShiftX);
+    return (bp + pageIdx * 32) << (info.blockShiftX + info.blockShiftY);
+}
+
+// Elements in VRAM minus one; in-page offsets stay below a block, so adding
+// them before masking wraps like masking the block number
+static inline u32 PageElementMask(const PsmInfo& info)
+{
+    return ((vramBlockMask + 1) << (info.blockShiftX + info.blockShiftY)) - 1;
+}
+
+static inline u32 PageOffset(const PsmInfo& info, int x, int y)
+{
+    int px = x & ((1 << info.pageShiftX) - 1);
+    int py = y & ((1 << info.pageShiftY) - 1);
+    return info.pageTable[(py << info.pageShiftX) + px];
+}
+
+u32 PixelAddress(int x, int y, u32 bp, u32 bw, u32 psm)
+{
+    const PsmInfo* info = FindPsmInfo(psm);
+    if (!info)
+        return 0;
+
+    return (PageElementBase(*info, x, y, bp, bw) + PageOffset(*info, x, y)) & PageElementMask(*info);
+}
+
+// Raw element value at element address addr, as the host transfers it
+static u32 LoadElement(const PsmInfo& info, const u8* vram, u32 addr)
+{
+    const u8* word = vram + static_cast<size_t>(addr) * 4;
+    switch (info.element)
+    {
+    case PsmElement::Color32:  return LoadU32(word);
+    case PsmElement::Color24:  return LoadU32(word) & 0x00FFFFFF;
+    case PsmElement::Color16:  return LoadU16(vram + static_cast<size_t>(addr) * 2);
+    case PsmElement::Index8:   return vram[addr];
+    case PsmElement::Index4:   return (vram[addr >> 1] >> ((addr & 1) * 4)) & 0xF;
+    case PsmElement::Index8H:  return LoadU32(word) >> 24;
+    case PsmElement::Index4HL: return (LoadU32(word) >> 24) & 0xF;
+    case PsmElement::Index4HH: return LoadU32(word) >> 28;
+    }
+    return 0;
+}
+
+// Formats sharing a word with others only replace their own bits
+static void StoreElement(const PsmInfo& info, u8* vram, u32 addr, u32 value)
+{
+    u8* word = vram + static_cast<size_t>(addr) * 4;
+    switch (info.element)
+    {
+    case PsmElement::Color32:  StoreU32(word, value); break;
+    case PsmElement::Color24:  StoreU32(word, (LoadU32(word) & 0xFF000000) | (value & 0x00FFFFFF)); break;
+    case PsmElement::Color16:  StoreU16(vram + static_cast<size_t>(addr) * 2, static_cast<u16>(value)); break;
+    case PsmElement::Index8:   vram[addr] = static_cast<u8>(value); break;
+    case PsmElement::Index4:
+    {
+        const int shift = (addr & 1) * 4;
+        vram[addr >> 1] = static_cast<u8>((vram[addr >> 1] & ~(0xF << shift)) | ((value & 0xF) << shift));
+        break;
+    }
+    case PsmElement::Index8H:  StoreU32(word, (LoadU32(word) & 0x00FFFFFF) | (value << 24)); break;
+    case PsmElement::Index4HL: StoreU32(word, (LoadU32(word) & 0xF0FFFFFF) | ((value & 0xF) << 24)); break;
+    case PsmElement::Index4HH: StoreU32(word, (LoadU32(word) & 0x0FFFFFFF) | ((value & 0xF) << 28)); break;
+    }
+}
+
+// Run func(element address, i) for count pixels of row y starting at x, one
+// page span at a time so each pixel costs a table lookup and an add.
+// Coordinates wrap at 2048 like GS transfers (pages never straddle the wrap).
+template <typename Func>
+static inline void ForEachRowElement(const PsmInfo& info, int x, int y, int count, u32 bp, u32 bw, Func func)
+{
+    y &= 2047;
+    const int page_width = 1 << info.pageShiftX;
+    const u16* row = info.pageTable + ((y & ((1 << info.pageShiftY) - 1)) << info.pageShiftX);
+    const u32 mask = PageElementMask(info);
+
+    for (int i = 0; i < count;)
+    {
+        const int px = (x + i) & 2047;
+        const u32 base = PageElementBase(info, px, y, bp, bw);
+        const u16* offsets = row + (px & (page_width - 1));
+        int span = page_width - (px & (page_width - 1));
+        if (span > count - i)
+            span = count - i;
+
+        for (int j = 0; j < span; j++)
+            func((base + offsets[j]) & mask, i + j);
+        i += span;
+    }
+}
+
+bool ReadPixels(const u8* vram, int x, int y, int count, u32 bp, u32 bw, u32 psm, u32* values)
+{
+    const PsmInfo* info = FindPsmInfo(psm);
+    if (!info)
+        return false;
+
+    ForEachRowElement(*info, x, y, count, bp, bw, [&](u32 addr, int i) { values[i] = LoadElement(*info, vram, addr); });
+    return true;
+}
+
+bool WritePixels(u8* vram, int x, int y, int count, u32 bp, u32 bw, u32 psm, const u32* values)
+{
+    const PsmInfo* info = FindPsmInfo(psm);
+    if (!info)
+        return false;
+
+    ForEachRowElement(*info, x, y, count, bp, bw, [&](u32 addr, int i) { StoreElement(*info, vram, addr, values[i]); });
+    return true;
+}
+
+static const u32* GetGrayPalette(int entries)
+{
+    struct GrayPalettes
+    {
+        u32 gray256[256];
+        u32 gray16[16];
+
+        GrayPalettes()
+        {
+            for (u32 i = 0; i < 256; i++)
+                gray256[i] = i | (i << 8) | (i << 16) | 0xFF000000;
+            for (u32 i = 0; i < 16; i++)
+                gray16[i] = (i * 17) | ((i * 17) << 8) | ((i * 17) << 16) | 0xFF000000;
+        }
+    };
+    static const GrayPalettes palettes;
+    return entries == 16 ? palettes.gray16 : palettes.gray256;
+}
+
+static PixelConverter MakePixelConverter(const PsmInfo& info, bool force_alpha, const u32* palette)
+{
+    // 16-bit alpha expands the way TEXA does with TA0 = 0, TA1 = 0x80. 24-bit
+    // pixels would get TA0 and come out invisible; they are made opaque at 0x80
+    // instead, on purpose
+    PixelConverter conv;
+    conv.mask = info.element == PsmElement::Color24 || force_alpha ? 0x00FFFFFF : 0xFFFFFFFF;
+    conv.alpha = force_alpha ? 0xFF000000 : info.element == PsmElement::Color24 ? 0x80000000 : 0;
+    conv.alpha16[0] = force_alpha ? 0xFF000000 : 0;
+    conv.alpha16[1] = force_alpha ? 0xFF000000 : 0x80000000;
+
+    // Without a CLUT, indices come out as gray levels
+    bool four_bit = info.element == PsmElement::Index4 || info.element == PsmElement::Index4HL || info.element == PsmElement::Index4HH;
+    conv.palette = palette ? palette : GetGrayPalette(four_bit ? 16 : 256);
+    return conv;
+}
+
+// Walk the rect at (x0, y0) one block at a time. Whole blocks go to block_fn;
+// blocks that only partly overlap the rect go to pixel_fn one pixel at a time.
+// PixelSize is the image bytes per pixel. Reading passes const VRAM and a
+// writable image, writing the other way round.
+template <int PixelSize, typename Vram, typename Image, typename BlockFn, typename PixelFn>
+static void ForEachBlock(const PsmInfo& info, Vram* vram, Image* image, size_t stride, int x0, int y0, int width, int height, u32 bp, u32 bw, BlockFn block_fn, PixelFn pixel_fn)
+{
+    const int block_width = 1 << info.blockShiftX;
+    const int block_height = 1 << info.blockShiftY;
+    const int x1 = x0 + width;
+    const int y1 = y0 + height;
+
+    for (int by = y0 & ~(block_height - 1); by < y1; by += block_height)
+    {
+        for (int bx = x0 & ~(block_width - 1); bx < x1; bx += block_width)
+        {
+            Vram* block = vram + BlockAddress(info, bx, by, bp, bw);
+
+            if (bx >= x0 && by >= y0 && bx + block_width <= x1 && by + block_height <= y1)
+            {
+                block_fn(block, image + (by - y0) * stride + (bx - x0) * PixelSize);
+                continue;
+            }
+
+            const int py0 = by > y0 ? by : y0;
+            const int py1 = by + block_height < y1 ? by + block_height : y1;
+            const int px0 = bx > x0 ? bx : x0;
+            const int px1 = bx + block_width < x1 ? bx + block_width : x1;
+            for (int y = py0; y < py1; y++)
+            {
+                Image* row = image + (y - y0) * stride;
+                for (int x = px0; x < px1; x++)
+                    pixel_fn(block, BlockElement(info, x, y), row + (x - x0) * PixelSize);
+            }
+        }
+    }
+}
+
+static void DeswizzleBlocks(const PsmInfo& info, const u8* vram, u8* out, size_t stride, int x0, int y0, int width, int height, u32 bp, u32 bw, const PixelConverter& conv)
+{
+    ForEachBlock<4>(info, vram, out, stride, x0, y0, width, height, bp, bw,
+        [&](const u8* block, u8* dst) { info.kernel(block, dst, stride, conv); },
+        [&](const u8* block, u32 element, u8* dst) { StoreU32(dst, info.reader(block, element, conv)); });
+}
+
+template <int PixelSize>
+static void SwizzleBlocks(const PsmInfo& info, u8* vram, const u8* src, size_t stride, int x0, int y0, int width, int height, u32 bp, u32 bw)
+{
+    ForEachBlock<PixelSize>(info, vram, src, stride, x0, y0, width, height, bp, bw,
+        [&](u8* block, const u8* pixels) { info.swizzler(block, pixels, stride); },
+        [&](u8* block, u32 element, const u8* pixel) { info.writer(block, element, pixel); });
+}
+
+template <PsmElement E, int BlockWidth, int BlockHeight>
+static void ExtractIndexBlocks(const PsmInfo& info, const u8* vram, u8* out, size_t stride, int x0, int y0, int width, int height, u32 bp, u32 bw)
+{
+    ForEachBlock<1>(info, vram, out, stride, x0, y0, width, height, bp, bw,
+        [&](const u8* block, u8* dst) { ExtractIndexBlockLUT<E, BlockWidth, BlockHeight>(block, dst, stride); },
+        [&](const u8* block, u32 element, u8* dst) { *dst = static_cast<u8>(ReadIndex<E>(block, element)); });
+}
+
+static void ExtractIndices(const PsmInfo& info, const u8* vram, u8* out, size_t stride, int x0, int y0, int width, int height, u32 bp, u32 bw)
+{
+    switch (info.element)
+    {
+    case PsmElement::Index8:   ExtractIndexBlocks<PsmElement::Index8, 16, 16>(info, vram, out, stride, x0, y0, width, height, bp, bw); break;
+    case PsmElement::Index4:   ExtractIndexBlocks<PsmElement::Index4, 32, 16>(info, vram, out, stride, x0, y0, width, height, bp, bw); break;
+    case PsmElement::Index8H:  ExtractIndexBlocks<PsmElement::Index8H, 8, 8>(info, vram, out, stride, x0, y0, width, height, bp, bw); break;
+    case PsmElement::Index4HL: ExtractIndexBlocks<PsmElement::Index4HL, 8, 8>(info, vram, out, stride, x0, y0, width, height, bp, bw); break;
+    case PsmElement::Index4HH: ExtractIndexBlocks<PsmElement::Index4HH, 8, 8>(info, vram, out, stride, x0, y0, width, height, bp, bw); break;
+    default: break;
+    }
+}
+
+// Run func(y0, y1) for each row of pages overlapping rows [y, y + height).
+// Each call owns its rows, so output regions never overlap.
+template <typename Func>
+static void ForEachPageRow(const PsmInfo& info, int y, int height, ThreadPool& pool, Func func)
+{
+    const int page_height = 1 << info.pageShiftY;
+    const int first_page_y = y & ~(page_height - 1);
+    const int page_rows = (y + height - first_page_y + page_height - 1) / page_height;
+    pool.ParallelFor(page_rows, [=](int page_row)
+    {
+        int y0 = first_page_y + page_row * page_height;
+        int y1 = y0 + page_height;
+        if (y0 < y) y0 = y;
+        if (y1 > y + height) y1 = y + height;
+        func(y0, y1);
+    });
+}
+
+void DeswizzleImage32(const u8* vram, u8* out, int width, int height, u32 bw, bool force_alpha)
+{
+    DeswizzleRect(vram, out, 0, 0, width, height, 0, bw, PSMCT32, force_alpha, nullptr);
+}
+
+void DeswizzleImage32(const u8* vram, u8* out, int width, int height, u32 bw, bool force_alpha, ThreadPool& pool)
+{
+    DeswizzleRect(vram, out, 0, 0, width, height, 0, bw, PSMCT32, force_alpha, nullptr, pool);
+}
+
+void DeswizzleRect32(const u8* vram, u8* out, int x, int y, int width, int height, u32 bp, u32 bw, bool force_alpha)
+{
+    DeswizzleRect(vram, out, x, y, width, height, bp, bw, PSMCT32, force_alpha, nullptr);
+}
+
+void DeswizzleRect32(const u8* vram, u8* out, int x, int y, int width, int height, u32 bp, u32 bw, bool force_alpha, ThreadPool& pool)
+{
+    DeswizzleRect(vram, out, x, y, width, height, bp, bw, PSMCT32, force_alpha, nullptr, pool);
+}
+
+bool DeswizzleRect(const u8* vram, u8* out, int x, int y, int width, int height, u32 bp, u32 bw, u32 psm, bool force_alpha, const u32* palette)
+{
+    const PsmInfo* info = FindPsmInfo(psm);
+    if (!info)
+        return false;
+
+    const PixelConverter conv = MakePixelConverter(*info, force_alpha, palette);
+    DeswizzleBlocks(*info, vram, out, static_cast<size_t>(width) * 4, x, y, width, height, bp, bw, conv);
+    return true;
+}
+
+bool DeswizzleRect(const u8* vram, u8* out, int x, int y, int width, int height, u32 bp, u32 bw, u32 psm, bool force_alpha, const u32* palette, ThreadPool& pool)
+{
+    const PsmInfo* info = FindPsmInfo(psm);
+    if (!info)
+        return false;
+
+    const PixelConverter conv = MakePixelConverter(*info, force_alpha, palette);
+    const size_t stride = static_cast<size_t>(width) * 4;
+    ForEachPageRow(*info, y, height, pool, [=, &conv](int y0, int y1)
+    {
+        DeswizzleBlocks(*info, vram, out + (y0 - y) * stride, stride, x, y0, width, y1 - y0, bp, bw, conv);
+    });
+    return true;
+}
+
+bool ExtractIndexRect(const u8* vram, u8* out, int x, int y, int width, int height, u32 bp, u32 bw, u32 psm)
+{
+    const PsmInfo* info = FindPsmInfo(psm);
+    if (!info || info->element < PsmElement::Index8)
+        return false;
+
+    ExtractIndices(*info, vram, out, width, x, y, width, height, bp, bw);
+    return true;
+}
+
+bool ExtractIndexRect(const u8* vram, u8* out, int x, int y, int width, int height, u32 bp, u32 bw, u32 psm, ThreadPool& pool)
+{
+    const PsmInfo* info = FindPsmInfo(psm);
+    if (!info || info->element < PsmElement::Index8)
+        return false;
+
+    const size_t stride = width;
+    ForEachPageRow(*info, y, height, pool, [=](int y0, int y1)
+    {
+        ExtractIndices(*info, vram, out + (y0 - y) * stride, stride, x, y0, width, y1 - y0, bp, bw);
+    });
+    return true;
+}
+
+bool SwizzleRect(u8* vram, const u8* rgba, int x, int y, int width, int height, u32 bp, u32 bw, u32 psm)
+{
+    const PsmInfo* info = FindPsmInfo(psm);
+    if (!info || info->element >= PsmElement::Index8)
+        return false;
+
+    SwizzleBlocks<4>(*info, vram, rgba, static_cast<size_t>(width) * 4, x, y, width, height, bp, bw);
+    return true;
+}
+
+bool SwizzleIndexRect(u8* vram, const u8* indices, int x, int y, int width, int height, u32 bp, u32 bw, u32 psm)
+{
+    const PsmInfo* info = FindPsmInfo(psm);
+    if (!info || info->element < PsmElement::Index8)
+        return false;
+
+    SwizzleBlocks<1>(*info, vram, indices, width, x, y, width, height, bp, bw);
+    return true;
+}
+
+int GetClutEntryCount(u32 psm)
+{
+    const PsmInfo* info = FindPsmInfo(psm);
+    if (!info || info->element < PsmElement::Index8)
+        return 0;
+    return info->element == PsmElement::Index8 || info->element == PsmElement::Index8H ? 256 : 16;
+}
+
+// Position of CLUT entry i in its buffer
+static void GetClutPosition(u32 csm, int entries, int i, int* x, int* y)
+{
+    *x = i;
+    *y = 0;
+    if (csm == 0 && entries == 256)
+    {
+        // CSM1 256-entry CLUTs are 16x16 with entries 8-15 and 16-23 of
+        // every 32 swapped
+        int j = (i & ~0x18) | ((i & 0x08) << 1) | ((i & 0x10) >> 1);
+        *x = j & 15;
+        *y = j >> 4;
+    }
+    else if (csm == 0)
+    {
+        // CSM1 16-entry CLUTs are 8x2
+        *x = i & 7;
+        *y = i >> 3;
+    }
+}
+
+static const PsmInfo* FindClutInfo(u32 cpsm, u32 csm, u32 psm)
+{
+    if ((cpsm != PSMCT32 && cpsm != PSMCT16 && cpsm != PSMCT16S) || GetClutEntryCount(psm) == 0 || csm > 1)
+        return nullptr;
+    if (csm == 1 && cpsm != PSMCT16)
+        return nullptr;
+    return FindPsmInfo(cpsm);
+}
+
+// CSM2 entries run along the first row of a buffer wide enough to hold them;
+// TEXCLUT would place them elsewhere, but its CBW/COU/COV are not modelled
+static u32 GetClutBufferWidth(u32 csm, int entries)
+{
+    return csm == 0 ? 1 : (entries + 63) / 64;
+}
+
+bool ReadClut(const u8* vram, u32 cbp, u32 cpsm, u32 csm, u32 psm, bool force_alpha, u32* palette)
+{
+    const PsmInfo* clut = FindClutInfo(cpsm, csm, psm);
+    if (!clut)
+        return false;
+
+    const int entries = GetClutEntryCount(psm);
+    const u32 bw = GetClutBufferWidth(csm, entries);
+    const PixelConverter conv = MakePixelConverter(*clut, force_alpha, nullptr);
+
+    for (int i = 0; i < entries; i++)
+    {
+        int x, y;
+        GetClutPosition(csm, entries, i, &x, &y);
+        const u8* block = vram + BlockAddress(*clut, x, y, cbp, bw);
+        palette[i] = clut->reader(block, BlockElement(*clut, x, y), conv);
+    }
+    return true;
+}
+
+bool WriteClut(u8* vram, u32 cbp, u32 cpsm, u32 csm, u32 psm, const u32* palette)
+{
+    const PsmInfo* clut = FindClutInfo(cpsm, csm, psm);
+    if (!clut)
+        return false;
+
+    const int entries = GetClutEntryCount(psm);
+    const u32 bw = GetClutBufferWidth(csm, entries);
+
+    for (int i = 0; i < entries; i++)
+    {
+        int x, y;
+        GetClutPosition(csm, entries, i, &x, &y);
+        u8* block = vram + BlockAddress(*clut, x, y, cbp, bw);
+        clut->writer(block, BlockElement(*clut, x, y), reinterpret_cast<const u8*>(palette + i));
+    }
+    return true;
 }
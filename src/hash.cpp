@@ -0,0 +1,155 @@
+// 64-bit content hashing implementation
+#include "hash.h"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+static const u64 PRIME1 = 0x9E3779B185EBCA87ull;
+static const u64 PRIME2 = 0xC2B2AE3D27D4EB4Full;
+static const u64 PRIME3 = 0x165667B19E3779F9ull;
+static const u64 PRIME4 = 0x85EBCA77C2B2AE63ull;
+static const u64 PRIME5 = 0x27D4EB2F165667C5ull;
+
+static inline u64 RotateLeft(u64 value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static inline u64 Load64(const u8* p)
+{
+    u64 value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline u32 Load32(const u8* p)
+{
+    u32 value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline u64 Round(u64 acc, u64 input)
+{
+    acc += input * PRIME2;
+    return RotateLeft(acc, 31) * PRIME1;
+}
+
+static inline u64 MergeRound(u64 hash, u64 acc)
+{
+    hash ^= Round(0, acc);
+    return hash * PRIME1 + PRIME4;
+}
+
+Hash64::Hash64(u64 seed)
+    : m_buffered(0)
+    , m_total(0)
+    , m_seed(seed)
+{
+    m_acc[0] = seed + PRIME1 + PRIME2;
+    m_acc[1] = seed + PRIME2;
+    m_acc[2] = seed;
+    m_acc[3] = seed - PRIME1;
+}
+
+void Hash64::Update(const void* data, size_t size)
+{
+    const u8* p = static_cast<const u8*>(data);
+    m_total += size;
+
+    // Top up a partial stripe first
+    if (m_buffered)
+    {
+        size_t take = 32 - m_buffered < size ? 32 - m_buffered : size;
+        memcpy(m_buffer + m_buffered, p, take);
+        m_buffered += take;
+        p += take;
+        size -= take;
+        if (m_buffered < 32)
+            return;
+
+        for (int i = 0; i < 4; i++)
+            m_acc[i] = Round(m_acc[i], Load64(m_buffer + i * 8));
+        m_buffered = 0;
+    }
+
+    // Whole 32-byte stripes, one lane per accumulator
+    u64 v0 = m_acc[0], v1 = m_acc[1], v2 = m_acc[2], v3 = m_acc[3];
+    for (; size >= 32; p += 32, size -= 32)
+    {
+        v0 = Round(v0, Load64(p + 0));
+        v1 = Round(v1, Load64(p + 8));
+        v2 = Round(v2, Load64(p + 16));
+        v3 = Round(v3, Load64(p + 24));
+    }
+    m_acc[0] = v0;
+    m_acc[1] = v1;
+    m_acc[2] = v2;
+    m_acc[3] = v3;
+
+    memcpy(m_buffer, p, size);
+    m_buffered = size;
+}
+
+u64 Hash64::Finish() const
+{
+    u64 hash;
+    if (m_total >= 32)
+    {
+        hash = RotateLeft(m_acc[0], 1) + RotateLeft(m_acc[1], 7) + RotateLeft(m_acc[2], 12) + RotateLeft(m_acc[3], 18);
+        for (int i = 0; i < 4; i++)
+            hash = MergeRound(hash, m_acc[i]);
+    }
+    else
+    {
+        hash = m_seed + PRIME5;
+    }
+    hash += m_total;
+
+    const u8* p = m_buffer;
+    size_t size = m_buffered;
+    for (; size >= 8; p += 8, size -= 8)
+        hash = RotateLeft(hash ^ Round(0, Load64(p)), 27) * PRIME1 + PRIME4;
+    if (size >= 4)
+    {
+        hash = RotateLeft(hash ^ (Load32(p) * PRIME1), 23) * PRIME2 + PRIME3;
+        p += 4;
+        size -= 4;
+    }
+    for (; size > 0; p++, size--)
+        hash = RotateLeft(hash ^ (*p * PRIME5), 11) * PRIME1;
+
+    // Final avalanche
+    hash ^= hash >> 33;
+    hash *= PRIME2;
+    hash ^= hash >> 29;
+    hash *= PRIME3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+u64 HashBytes(const void* data, size_t size, u64 seed)
+{
+    Hash64 hash(seed);
+    hash.Update(data, size);
+    return hash.Finish();
+}
+
+bool HashFile(const char* filename, u64* hash)
+{
+    FILE* fp = fopen(filename, "rb");
+    if (!fp)
+        return false;
+
+    Hash64 state;
+    std::vector<u8> buffer(1024 * 1024);
+    size_t count;
+    while ((count = fread(buffer.data(), 1, buffer.size(), fp)) > 0)
+        state.Update(buffer.data(), count);
+
+    const bool ok = !ferror(fp);
+    fclose(fp);
+    *hash = state.Finish();
+    return ok;
+}
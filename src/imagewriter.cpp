@@ -0,0 +1,302 @@
+// Output formats implementation
+#include "imagewriter.h"
+#include "pngwriter.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <strings.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+struct ImageFormatInfo
+{
+    ImageFormat format;
+    const char* name;
+    const char* extension;
+    const char* description;
+};
+
+// The first entry of a format gives its extension
+static const ImageFormatInfo s_formats[] =
+{
+    { ImageFormat::Png, "png", ".png", "PNG" },
+    { ImageFormat::Qoi, "qoi", ".qoi", "QOI" },
+    { ImageFormat::Raw, "rgba", ".rgba", "raw RGBA" },
+    { ImageFormat::Raw, "raw", ".raw", "raw RGBA" },
+    { ImageFormat::Pam, "pam", ".pam", "PAM" },
+    { ImageFormat::Dds, "dds", ".dds", "DDS" },
+};
+
+static const char* const s_tileOrderNames[] = { "linear", "pages", "morton" };
+
+bool FindTileOrder(const char* name, TileOrder* order)
+{
+    for (size_t i = 0; i < sizeof(s_tileOrderNames) / sizeof(s_tileOrderNames[0]); i++)
+    {
+        if (strcasecmp(name, s_tileOrderNames[i]) == 0)
+        {
+            *order = static_cast<TileOrder>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* GetTileOrderName(TileOrder order)
+{
+    return s_tileOrderNames[static_cast<int>(order)];
+}
+
+bool FindImageFormat(const char* name, ImageFormat* format)
+{
+    for (const ImageFormatInfo& info : s_formats)
+    {
+        if (strcasecmp(name, info.name) == 0)
+        {
+            *format = info.format;
+            return true;
+        }
+    }
+    return false;
+}
+
+ImageFormat GetImageFormatFromPath(const char* path)
+{
+    const char* slash = strrchr(path, '/');
+    const char* dot = strrchr(slash ? slash : path, '.');
+    if (dot)
+    {
+        for (const ImageFormatInfo& info : s_formats)
+        {
+            if (strcasecmp(dot, info.extension) == 0)
+                return info.format;
+        }
+    }
+    return ImageFormat::Png;
+}
+
+ImageFormat ResolveImageFormat(ImageFormat format, const char* path)
+{
+    return format == ImageFormat::Auto ? GetImageFormatFromPath(path) : format;
+}
+
+const char* GetImageFormatExtension(ImageFormat format)
+{
+    for (const ImageFormatInfo& info : s_formats)
+    {
+        if (info.format == format)
+            return info.extension;
+    }
+    return ".png";
+}
+
+const char* GetImageFormatName(ImageFormat format)
+{
+    for (const ImageFormatInfo& info : s_formats)
+    {
+        if (info.format == format)
+            return info.description;
+    }
+    return "PNG";
+}
+
+static void PutU32LE(std::vector<u8>* out, u32 value)
+{
+    for (int i = 0; i < 4; i++)
+        out->push_back(static_cast<u8>(value >> (i * 8)));
+}
+
+static void PutU32BE(std::vector<u8>* out, u32 value)
+{
+    for (int i = 3; i >= 0; i--)
+        out->push_back(static_cast<u8>(value >> (i * 8)));
+}
+
+// DDS_HEADER with an uncompressed 32-bit RGBA DDS_PIXELFORMAT
+static void GetDDSHeader(int width, int height, std::vector<u8>* out)
+{
+    const char magic[4] = { 'D', 'D', 'S', ' ' };
+    out->insert(out->end(), magic, magic + 4);
+    PutU32LE(out, 124);                     // dwSize
+    PutU32LE(out, 0x100F);                  // CAPS | HEIGHT | WIDTH | PITCH | PIXELFORMAT
+    PutU32LE(out, static_cast<u32>(height));
+    PutU32LE(out, static_cast<u32>(width));
+    PutU32LE(out, static_cast<u32>(width) * 4);
+    PutU32LE(out, 0);                       // dwDepth
+    PutU32LE(out, 0);                       // dwMipMapCount
+    for (int i = 0; i < 11; i++)
+        PutU32LE(out, 0);                   // dwReserved1
+
+    PutU32LE(out, 32);                      // ddspf.dwSize
+    PutU32LE(out, 0x41);                    // DDPF_RGB | DDPF_ALPHAPIXELS
+    PutU32LE(out, 0);                       // dwFourCC
+    PutU32LE(out, 32);                      // dwRGBBitCount
+    PutU32LE(out, 0x000000FF);              // R, G, B, A masks for bytes in RGBA order
+    PutU32LE(out, 0x0000FF00);
+    PutU32LE(out, 0x00FF0000);
+    PutU32LE(out, 0xFF000000);
+
+    PutU32LE(out, 0x1000);                  // DDSCAPS_TEXTURE
+    for (int i = 0; i < 4; i++)
+        PutU32LE(out, 0);                   // dwCaps2-4, dwReserved2
+}
+
+void GetImageHeader(ImageFormat format, int width, int height, std::vector<u8>* out)
+{
+    out->clear();
+    if (format == ImageFormat::Pam)
+    {
+        char header[128];
+        int length = snprintf(header, sizeof(header), "P7\nWIDTH %d\nHEIGHT %d\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n", width, height);
+        out->insert(out->end(), header, header + length);
+    }
+    else if (format == ImageFormat::Dds)
+    {
+        GetDDSHeader(width, height, out);
+    }
+}
+
+bool EncodeQOI(const u8* rgba, int width, int height, int stride, std::vector<u8>* out)
+{
+    if (width <= 0 || height <= 0)
+        return false;
+
+    // Worst case is five bytes a pixel, plus the header and end marker
+    out->clear();
+    out->reserve(static_cast<size_t>(width) * height * 5 + 22);
+    const char magic[4] = { 'q', 'o', 'i', 'f' };
+    out->insert(out->end(), magic, magic + 4);
+    PutU32BE(out, static_cast<u32>(width));
+    PutU32BE(out, static_cast<u32>(height));
+    out->push_back(4);  // RGBA
+    out->push_back(0);  // sRGB with linear alpha
+
+    u32 seen[64] = {};
+    u8 prev[4] = { 0, 0, 0, 255 };
+    int run = 0;
+    for (int y = 0; y < height; y++)
+    {
+        const u8* row = rgba + static_cast<size_t>(y) * stride;
+        for (int x = 0; x < width; x++)
+        {
+            const u8* px = row + x * 4;
+            if (memcmp(px, prev, 4) == 0)
+            {
+                if (++run == 62)
+                {
+                    out->push_back(static_cast<u8>(0xC0 | (run - 1)));   // QOI_OP_RUN
+                    run = 0;
+                }
+                continue;
+            }
+
+            if (run > 0)
+            {
+                out->push_back(static_cast<u8>(0xC0 | (run - 1)));
+                run = 0;
+            }
+
+            u32 value;
+            memcpy(&value, px, 4);
+            const int hash = (px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64;
+            if (seen[hash] == value)
+            {
+                out->push_back(static_cast<u8>(hash));                  // QOI_OP_INDEX
+            }
+            else
+            {
+                seen[hash] = value;
+                if (px[3] == prev[3])
+                {
+                    const int dr = static_cast<s8>(px[0] - prev[0]);
+                    const int dg = static_cast<s8>(px[1] - prev[1]);
+                    const int db = static_cast<s8>(px[2] - prev[2]);
+                    const int dr_dg = dr - dg;
+                    const int db_dg = db - dg;
+                    if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+                    {
+                        out->push_back(static_cast<u8>(0x40 | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2)));   // QOI_OP_DIFF
+                    }
+                    else if (dr_dg >= -8 && dr_dg <= 7 && dg >= -32 && dg <= 31 && db_dg >= -8 && db_dg <= 7)
+                    {
+                        out->push_back(static_cast<u8>(0x80 | (dg + 32)));                                  // QOI_OP_LUMA
+                        out->push_back(static_cast<u8>((dr_dg + 8) << 4 | (db_dg + 8)));
+                    }
+                    else
+                    {
+                        out->push_back(0xFE);                                                               // QOI_OP_RGB
+                        out->insert(out->end(), px, px + 3);
+                    }
+                }
+                else
+                {
+                    out->push_back(0xFF);                                                                   // QOI_OP_RGBA
+                    out->insert(out->end(), px, px + 4);
+                }
+            }
+            memcpy(prev, px, 4);
+        }
+    }
+
+    if (run > 0)
+        out->push_back(static_cast<u8>(0xC0 | (run - 1)));
+
+    const u8 end_marker[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+    out->insert(out->end(), end_marker, end_marker + 8);
+    return true;
+}
+
+bool WriteImageFile(const char* filename, const u8* header, size_t header_size, const u8* data, size_t size)
+{
+    FILE* fp = CreateOutputFile(filename);
+    if (!fp)
+        return false;
+
+    iovec parts[2] = { { const_cast<u8*>(header), header_size }, { const_cast<u8*>(data), size } };
+    iovec* part = parts;
+    int count = 2;
+    bool ok = true;
+    while (ok && count > 0)
+    {
+        ssize_t written = writev(fileno(fp), part, count);
+        ok = written >= 0;
+
+        // Short write: skip what went out and go again
+        for (size_t left = ok ? static_cast<size_t>(written) : 0; count > 0 && (left > 0 || part->iov_len == 0);)
+        {
+            const size_t step = left < part->iov_len ? left : part->iov_len;
+            part->iov_base = static_cast<u8*>(part->iov_base) + step;
+            part->iov_len -= step;
+            left -= step;
+            if (part->iov_len == 0)
+            {
+                part++;
+                count--;
+            }
+        }
+    }
+
+    return fclose(fp) == 0 && ok;
+}
+
+bool WriteRawSidecar(const char* filename, int width, int height, TileOrder order, int tile_width, int tile_height)
+{
+    const std::string path = std::string(filename) + ".json";
+    FILE* fp = fopen(path.c_str(), "w");
+    if (!fp)
+        return false;
+
+    if (order == TileOrder::Linear)
+    {
+        fprintf(fp, "{\"width\": %d, \"height\": %d, \"stride\": %d, \"format\": \"rgba8\"}\n", width, height, width * 4);
+    }
+    else
+    {
+        fprintf(fp, "{\"width\": %d, \"height\": %d, \"format\": \"rgba8\", \"tile_order\": \"%s\", "
+            "\"tile_width\": %d, \"tile_height\": %d, \"tiles_x\": %d, \"tiles_y\": %d}\n",
+            width, height, GetTileOrderName(order), tile_width, tile_height,
+            (width + tile_width - 1) / tile_width, (height + tile_height - 1) / tile_height);
+    }
+    return fclose(fp) == 0;
+}
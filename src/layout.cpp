@@ -0,0 +1,300 @@
+// Buffer width and region detection implementation
+#include "layout.h"
+#include "convert.h"
+#include "gsswizzle.h"
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define GS_LAYOUT_X86 1
+#include <immintrin.h>
+#endif
+
+static const int PAGE_COUNT = 512;          // 8KB pages in 4MB of VRAM
+static const int BLOCKS_PER_PAGE = 32;
+static const int MAX_DETECT_WIDTH = 2048;
+static const u32 NO_DIFF = 0xFFFFFFFF;      // Page has no partner at this width
+
+// Edge comparisons: sum of absolute byte differences
+
+typedef u32 (*SumAbsDiffFn)(const u8* a, const u8* b, size_t size);
+
+static u32 SumAbsDiff_Scalar(const u8* a, const u8* b, size_t size)
+{
+    u32 sum = 0;
+    for (size_t i = 0; i < size; i++)
+        sum += a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+    return sum;
+}
+
+#ifdef GS_LAYOUT_X86
+
+__attribute__((target("sse2")))
+static u32 SumAbsDiff_SSE2(const u8* a, const u8* b, size_t size)
+{
+    __m128i sum = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16)
+    {
+        const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        sum = _mm_add_epi64(sum, _mm_sad_epu8(va, vb));
+    }
+
+    // Two 64-bit partial sums
+    u32 total = static_cast<u32>(_mm_cvtsi128_si32(sum) + _mm_cvtsi128_si32(_mm_srli_si128(sum, 8)));
+    return total + SumAbsDiff_Scalar(a + i, b + i, size - i);
+}
+
+#endif
+
+static SumAbsDiffFn SelectSumAbsDiff()
+{
+#ifdef GS_LAYOUT_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2"))
+        return SumAbsDiff_SSE2;
+#endif
+    return SumAbsDiff_Scalar;
+}
+
+static u32 SumAbsDiff(const u8* a, const u8* b, size_t size)
+{
+    static const SumAbsDiffFn fn = SelectSumAbsDiff();
+    return fn(a, b, size);
+}
+
+// All pixels of the edge equal the first
+static bool IsFlat(const u8* edge, size_t size, size_t pixel_bytes)
+{
+    for (size_t i = pixel_bytes; i < size; i++)
+    {
+        if (edge[i] != edge[i % pixel_bytes])
+            return false;
+    }
+    return true;
+}
+
+void LayoutDetector::ReadPageEdges(const u8* vram, u32 psm)
+{
+    const bool indexed = IsIndexedPsm(psm);
+    const size_t pixel_bytes = indexed ? 1 : 4;
+    m_pageWidth = GetPsmPageWidth(psm);
+    m_pageHeight = GetPsmPageHeight(psm);
+    m_maxPagesPerRow = std::min(MAX_DETECT_WIDTH / m_pageWidth, PAGE_COUNT / 2);
+    m_rowBytes = m_pageWidth * pixel_bytes;
+    m_columnBytes = m_pageHeight * pixel_bytes;
+
+    m_top.resize(PAGE_COUNT * m_rowBytes);
+    m_bottom.resize(PAGE_COUNT * m_rowBytes);
+    m_left.resize(PAGE_COUNT * m_columnBytes);
+    m_right.resize(PAGE_COUNT * m_columnBytes);
+    m_detail.resize(PAGE_COUNT);
+    m_leftDetail.resize(PAGE_COUNT);
+    m_rightDetail.resize(PAGE_COUNT);
+
+    // Each page on its own, as a buffer one page wide at the page's base pointer
+    const u32 bw = m_pageWidth / 64;
+    const int last_x = m_pageWidth - 1;
+    const int last_y = m_pageHeight - 1;
+    for (int page = 0; page < PAGE_COUNT; page++)
+    {
+        const u32 bp = page * BLOCKS_PER_PAGE;
+        u8* top = &m_top[page * m_rowBytes];
+        u8* bottom = &m_bottom[page * m_rowBytes];
+        u8* left = &m_left[page * m_columnBytes];
+        u8* right = &m_right[page * m_columnBytes];
+        if (indexed)
+        {
+            ExtractIndexRect(vram, top, 0, 0, m_pageWidth, 1, bp, bw, psm);
+            ExtractIndexRect(vram, bottom, 0, last_y, m_pageWidth, 1, bp, bw, psm);
+            ExtractIndexRect(vram, left, 0, 0, 1, m_pageHeight, bp, bw, psm);
+            ExtractIndexRect(vram, right, last_x, 0, 1, m_pageHeight, bp, bw, psm);
+        }
+        else
+        {
+            DeswizzleRect(vram, top, 0, 0, m_pageWidth, 1, bp, bw, psm, false, nullptr);
+            DeswizzleRect(vram, bottom, 0, last_y, m_pageWidth, 1, bp, bw, psm, false, nullptr);
+            DeswizzleRect(vram, left, 0, 0, 1, m_pageHeight, bp, bw, psm, false, nullptr);
+            DeswizzleRect(vram, right, last_x, 0, 1, m_pageHeight, bp, bw, psm, false, nullptr);
+        }
+
+        m_detail[page] = !IsFlat(top, m_rowBytes, pixel_bytes) || !IsFlat(bottom, m_rowBytes, pixel_bytes);
+        m_leftDetail[page] = !IsFlat(left, m_columnBytes, pixel_bytes);
+        m_rightDetail[page] = !IsFlat(right, m_columnBytes, pixel_bytes);
+    }
+
+    // Bottom of every page against the top of every page that could sit below it
+    m_rowDiffs.assign(static_cast<size_t>(PAGE_COUNT) * m_maxPagesPerRow, NO_DIFF);
+    m_meanDiffs.assign(PAGE_COUNT, 0);
+    for (int page = 0; page < PAGE_COUNT; page++)
+    {
+        u64 sum = 0;
+        int count = 0;
+        for (int k = 1; k <= m_maxPagesPerRow && page + k < PAGE_COUNT; k++)
+        {
+            const u32 diff = SumAbsDiff(&m_bottom[page * m_rowBytes], &m_top[(page + k) * m_rowBytes], m_rowBytes);
+            m_rowDiffs[page * m_maxPagesPerRow + k - 1] = diff;
+            sum += diff;
+            count++;
+        }
+        m_meanDiffs[page] = count ? static_cast<u32>(sum / count) : 0;
+    }
+}
+
+u32 LayoutDetector::GetRowDiff(int page, int pages_per_row) const
+{
+    if (pages_per_row < 1 || pages_per_row > m_maxPagesPerRow)
+        return NO_DIFF;
+    return m_rowDiffs[page * m_maxPagesPerRow + pages_per_row - 1];
+}
+
+// The page continues into the one below it at this width: a seamless edge, or
+// one much closer than at the other widths
+bool LayoutDetector::IsVerticalMatch(int page, int pages_per_row) const
+{
+    const u32 diff = GetRowDiff(page, pages_per_row);
+    return diff == 0 || (diff != NO_DIFF && static_cast<u64>(diff) * 2 < m_meanDiffs[page]);
+}
+
+// Every page with detail votes for the width its bottom edge matches best.
+// Returns 0 when no width gets a clear share of the votes.
+int LayoutDetector::DetectPagesPerRow() const
+{
+    std::vector<int> votes(m_maxPagesPerRow + 1, 0);
+    int total = 0;
+    for (int page = 0; page < PAGE_COUNT; page++)
+    {
+        if (!m_detail[page])
+            continue;
+
+        // Ties go to the narrowest width; twice as wide also lines up for smooth images
+        int best = 0;
+        for (int k = 1; k <= m_maxPagesPerRow; k++)
+        {
+            if (GetRowDiff(page, k) != NO_DIFF && (best == 0 || GetRowDiff(page, k) < GetRowDiff(page, best)))
+                best = k;
+        }
+
+        if (best != 0 && IsVerticalMatch(page, best))
+        {
+            votes[best]++;
+            total++;
+        }
+    }
+
+    const int winner = static_cast<int>(std::max_element(votes.begin(), votes.end()) - votes.begin());
+    return votes[winner] >= 4 && votes[winner] * 3 >= total ? winner : 0;
+}
+
+bool LayoutDetector::DetectRegion(int pages_per_row, ConvertOptions* options) const
+{
+    const int k = pages_per_row;
+    if (k < 1 || k > m_maxPagesPerRow)
+        return false;
+
+    // Rows of pages start where the right edge of a page breaks off from the
+    // left edge of the next: find the page column (bp mod k) where that happens
+    // most. Edges of one color are left out, since an image next to blank
+    // memory breaks off at its side as well. Without a clear break, rows
+    // start at the first page with anything in it.
+    const int first_detail = static_cast<int>(std::find(m_detail.begin(), m_detail.end(), 1) - m_detail.begin());
+    int first_page = first_detail < PAGE_COUNT ? first_detail % k : 0;
+    if (k > 1)
+    {
+        std::vector<u64> sums(k, 0);
+        std::vector<int> counts(k, 0);
+        u64 total = 0;
+        int total_count = 0;
+        for (int page = 0; page + 1 < PAGE_COUNT; page++)
+        {
+            if (!m_rightDetail[page] || !m_leftDetail[page + 1])
+                continue;
+
+            const u32 diff = SumAbsDiff(&m_right[page * m_columnBytes], &m_left[(page + 1) * m_columnBytes], m_columnBytes);
+            sums[(page + 1) % k] += diff;
+            counts[(page + 1) % k]++;
+            total += diff;
+            total_count++;
+        }
+
+        // Mean break at the column against the mean break anywhere, in integers
+        int best = 0;
+        for (int c = 1; c < k; c++)
+        {
+            if (sums[c] * counts[best] > sums[best] * counts[c])
+                best = c;
+        }
+        if (counts[best] && sums[best] * 2 * total_count > total * 3 * counts[best])
+            first_page = best;
+    }
+
+    // Link each page row to the next when most of its pages continue into it.
+    // Blank rows are not linked, so images separated by unused memory stay apart.
+    const int row_count = (PAGE_COUNT - first_page) / k;
+    std::vector<bool> detail(row_count, false);
+    std::vector<bool> linked(row_count, false);
+    for (int row = 0; row < row_count; row++)
+    {
+        int matches = 0;
+        for (int page = first_page + row * k; page < first_page + (row + 1) * k; page++)
+        {
+            if (m_detail[page])
+                detail[row] = true;
+            if (IsVerticalMatch(page, k))
+                matches++;
+        }
+        linked[row] = matches * 2 > k;
+    }
+
+    // Longest run of linked rows with detail; a lone row is too little to go on
+    int best_first = -1;
+    int best_count = 1;
+    for (int row = 0; row < row_count;)
+    {
+        int end = row;
+        while (end + 1 < row_count && detail[end] && detail[end + 1] && linked[end])
+            end++;
+
+        if (end - row + 1 > best_count)
+        {
+            best_first = row;
+            best_count = end - row + 1;
+        }
+        row = end + 1;
+    }
+
+    if (best_first < 0)
+        return false;
+
+    options->bp = (first_page + best_first * k) * BLOCKS_PER_PAGE;
+    options->has_rect = true;
+    options->rect_x = 0;
+    options->rect_y = 0;
+    options->rect_width = k * m_pageWidth;
+    options->rect_height = best_count * m_pageHeight;
+    return true;
+}
+
+bool LayoutDetector::Detect(const u8* vram, ConvertOptions* options)
+{
+    if (!vram || (!options->detect_width && !options->detect_region))
+        return true;
+
+    ReadPageEdges(vram, options->psm);
+
+    bool found = true;
+    if (options->detect_width)
+    {
+        const int pages_per_row = DetectPagesPerRow();
+        if (pages_per_row)
+            options->vram_width = pages_per_row * m_pageWidth;
+        else
+            found = false;
+    }
+
+    if (options->detect_region && !DetectRegion(options->vram_width / m_pageWidth, options))
+        found = false;
+
+    return found;
+}
@@ -1,28 +1,103 @@
 // gs2png - Convert PCSX2 GS Dump VRAM to PNG
-#include "gsdump.h"
+#include "batch.h"
+#include "buffers.h"
+#include "convert.h"
 #include "gsswizzle.h"
+#include "png2gs.h"
+#include "replay.h"
+#include "stats.h"
+#include "sweep.h"
+#include "threadpool.h"
+#include "watch.h"
 
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include "stb_image_write.h"
-
+#include <cerrno>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
-#include <vector>
+#include <strings.h>
+#include <sys/stat.h>
 
 void PrintUsage(const char* prog)
 {
     printf("Usage: %s <input.gs> <output.png> [options]\n", prog);
+    printf("       %s --batch <dir|glob|manifest> <output_dir> [options]\n", prog);
+    printf("       %s --replay <input.gs> <output_dir> [options]\n", prog);
+    printf("       %s --watch <dir> <output_dir> [options]\n", prog);
+    printf("       %s --png2gs <input.png> <dump.gs> [options]\n", prog);
+    printf("       %s <input.gs> <output_dir> --width-sweep <min..max> [options]\n", prog);
+    printf("       %s --from-stdin <output.png> [options]\n", prog);
     printf("\n");
     printf("Options:\n");
-    printf("  -w, --width <pixels>    VRAM buffer width in pixels (must be multiple of 64, default: 1024)\n");
+    printf("  -w, --width <pixels>    VRAM buffer width in pixels (must be multiple of 64, default: 1024),\n");
+    printf("                          or auto to guess it for each dump\n");
+    printf("  --psm <format>          Pixel storage format: ct32, ct24, ct16, ct16s, t8, t4, t8h, t4hl,\n");
+    printf("                          t4hh, z32, z24, z16 or z16s (default: ct32)\n");
+    printf("  --bp <blocks>           Buffer base pointer in 256-byte blocks (default: 0), or auto to\n");
+    printf("                          guess it and the rect of the largest image for each dump\n");
+    printf("  --rect <x,y,w,h>        Extract only this region of the buffer (default: all of VRAM)\n");
+    printf("  --cbp <blocks>          CLUT base pointer; index formats are written as palette PNGs\n");
+    printf("  --cpsm <format>         CLUT format: ct32, ct16 or ct16s (default: ct32)\n");
+    printf("  --csm <1|2>             CLUT storage mode (default: 1); 2 requires --cpsm ct16\n");
+    printf("  --expand-clut           Write CLUT colors as RGBA instead of a palette PNG\n");
     printf("  --force-alpha           Force alpha channel to 255 (prevents transparency)\n");
+    printf("  -j, --threads <count>   Worker threads for deswizzle and PNG encoding (0 = all cores, default: 0)\n");
+    printf("  --load <mmap|read>      How VRAM is loaded: map the file or read it (default: mmap)\n");
+    printf("  --format <format>       png, qoi, rgba (raw pixels plus a .json sidecar), pam or dds\n");
+    printf("                          (default: from the output extension, else png)\n");
+    printf("  --tile-order <order>    Raw output pixel order: linear, pages (one GS page tile after\n");
+    printf("                          another, e.g. 64x32 for ct32) or morton (pages in Z order)\n");
+    printf("  --png-speed <mode>      fast, balanced or max (stb encoder, single-threaded) (default: balanced)\n");
+    printf("  --cache <dir>           Reuse the PNG of any earlier conversion of identical VRAM with the\n");
+    printf("                          same options, hard-linked from this directory\n");
+    printf("  --huge-pages <mode>     Back VRAM and image buffers with 2MB pages: off, thp (transparent)\n");
+    printf("                          or explicit (reserved hugetlbfs pages, else thp) (default: off)\n");
+    printf("  --numa                  Keep each batch and watch worker, and the buffers it fills, on one\n");
+    printf("                          NUMA node, spreading workers over the nodes (best with --load read)\n");
+    printf("  --width-sweep <range>   Write one PNG per buffer width in a range like 64..2048 (in steps of\n");
+    printf("                          64, or 128 for 8-bit and 4-bit formats) into the output directory\n");
+    printf("  --contact-sheet         With --width-sweep, also tile a corner of every width into one PNG\n");
+    printf("  --frames <list>         Frames to write in replay mode, e.g. 0,5,10-20 (default: every vsync)\n");
+    printf("  --stats <text|json>     Report per-stage timings and counters for each file (and totals\n");
+    printf("                          for batch and replay runs) on stderr\n");
+    printf("  --stats-file <path>     Write the --stats report to a file instead (default format: json)\n");
     printf("  -h, --help              Show this help message\n");
     printf("\n");
+    printf("Batch mode converts every dump in a directory, every file matching a quoted\n");
+    printf("glob pattern, or every line of a manifest file (\"<input.gs> [output.png]\").\n");
+    printf("Dumps may be xz or zstd compressed (.gs.xz, .gs.zst); only the part up to the\n");
+    printf("end of VRAM is decompressed unless replaying.\n");
+    printf("Replay mode applies the dump's image transfers to VRAM and writes a PNG per\n");
+    printf("vsync (frame 0 is the VRAM saved at the start of the dump).\n");
+    printf("Watch mode converts new and changed dumps in a directory, then keeps running\n");
+    printf("and converts dumps as they arrive until interrupted. Finished work is kept in\n");
+    printf("<output_dir>/.gs2png-index so restarts skip unchanged dumps.\n");
+    printf("PNG to GS mode swizzles a PNG into the buffer given by -w, --psm, --bp and the\n");
+    printf("--rect origin, patching the VRAM of an uncompressed dump in place. Index formats\n");
+    printf("take a palette or grayscale PNG; with --cbp the palette is written to the CLUT.\n");
+    printf("--from-stdin reads the dump from a pipe (as does an input of -), up to the end of\n");
+    printf("VRAM. An output of - writes the image to stdout, with progress on stderr.\n");
+    printf("A width sweep loads the dump once and writes <name>_w<width>.png for every\n");
+    printf("width, to find the buffer width of an unknown image at a glance.\n");
+    printf("\n");
     printf("Examples:\n");
     printf("  %s input.gs output.png\n", prog);
     printf("  %s input.gs output.png --width 1024\n", prog);
     printf("  %s input.gs output.png -w 640 --force-alpha\n", prog);
+    printf("  %s input.gs output.png --threads 8\n", prog);
+    printf("  %s input.gs output.png -w 640 --bp 0x1180 --rect 0,0,640,448\n", prog);
+    printf("  %s input.gs output.png --psm t8 -w 128 --bp 0x2800 --rect 0,0,128,128\n", prog);
+    printf("  %s input.gs output.png --psm t4 -w 128 --bp 0x2800 --rect 0,0,64,64 --cbp 0x3000\n", prog);
+    printf("  %s input.gs output.png --png-speed fast\n", prog);
+    printf("  %s input.gs output.qoi -w 640\n", prog);
+    printf("  %s input.gs output.rgba -w 640 --tile-order morton\n", prog);
+    printf("  zstdcat input.gs.zst | %s --from-stdin - -w 640 > output.png\n", prog);
+    printf("  %s --batch dumps/ pngs/ -w 640\n", prog);
+    printf("  %s --batch 'dumps/*.gs' pngs/\n", prog);
+    printf("  %s --batch dumps/ pngs/ -w auto --bp auto\n", prog);
+    printf("  %s --replay input.gs frames/ --psm t8 -w 128 --bp 0x2800 --rect 0,0,128,128 --frames 1-60\n", prog);
+    printf("  %s --watch captures/ pngs/ -w 640 -j 4\n", prog);
+    printf("  %s input.gs widths/ --width-sweep 64..2048 --contact-sheet\n", prog);
+    printf("  %s --png2gs texture.png input.gs --psm t8 -w 128 --bp 0x2800 --rect 0,0,128,128 --cbp 0x3000\n", prog);
     printf("\n");
 }
 
@@ -34,25 +109,48 @@ int main(int argc, char** argv)
         return 1;
     }
 
-    const char* input_file = argv[1];
-    const char* output_file = argv[2];
-    int vram_width = 1024;
-    bool force_alpha = false;
+    const bool batch_mode = strcmp(argv[1], "--batch") == 0;
+    const bool replay_mode = strcmp(argv[1], "--replay") == 0;
+    const bool watch_mode = strcmp(argv[1], "--watch") == 0;
+    const bool png2gs_mode = strcmp(argv[1], "--png2gs") == 0;
+    const bool stdin_mode = strcmp(argv[1], "--from-stdin") == 0;
+    const int first_option = batch_mode || replay_mode || watch_mode || png2gs_mode ? 4 : 3;
+    if (argc < first_option)
+    {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    const char* input_file = stdin_mode ? "-" : argv[first_option - 2];
+    const char* output_file = argv[first_option - 1];
+    ConvertOptions options;
+    std::vector<FrameRange> frames;
+    int thread_count = 0;
+    WidthRange sweep_widths = {};
+    bool width_sweep = false;
+    bool contact_sheet = false;
+    StatsFormat stats_format = StatsFormat::None;
+    const char* stats_file = nullptr;
 
     // Parse command line options
-    for (int i = 3; i < argc; i++)
+    for (int i = first_option; i < argc; i++)
     {
         if (strcmp(argv[i], "-w") == 0 || strcmp(argv[i], "--width") == 0)
         {
-            if (i + 1 < argc)
+            if (i + 1 < argc && strcmp(argv[i + 1], "auto") == 0)
+            {
+                options.detect_width = true;
+                i++;
+            }
+            else if (i + 1 < argc)
             {
-                vram_width = atoi(argv[++i]);
-                if (vram_width <= 0)
+                options.vram_width = atoi(argv[++i]);
+                if (options.vram_width <= 0)
                 {
                     fprintf(stderr, "Error: Width must be positive\n");
                     return 1;
                 }
-                if (vram_width % 64 != 0)
+                if (options.vram_width % 64 != 0)
                 {
                     fprintf(stderr, "Error: Width must be a multiple of 64\n");
                     return 1;
@@ -64,9 +162,336 @@ int main(int argc, char** argv)
                 return 1;
             }
         }
+        else if (strcmp(argv[i], "--psm") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                if (!FindPsm(argv[++i], &options.psm))
+                {
+                    fprintf(stderr, "Error: Unknown pixel storage format: %s\n", argv[i]);
+                    return 1;
+                }
+            }
+            else
+            {
+                fprintf(stderr, "Error: --psm requires an argument\n");
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--bp") == 0)
+        {
+            if (i + 1 < argc && strcmp(argv[i + 1], "auto") == 0)
+            {
+                options.detect_region = true;
+                i++;
+            }
+            else if (i + 1 < argc)
+            {
+                char* end;
+                unsigned long bp = strtoul(argv[++i], &end, 0);
+                if (*end != '\0' || bp > 0x3FFF)
+                {
+                    fprintf(stderr, "Error: Base pointer must be a block number from 0 to 0x3FFF\n");
+                    return 1;
+                }
+                options.bp = static_cast<u32>(bp);
+            }
+            else
+            {
+                fprintf(stderr, "Error: --bp requires an argument\n");
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--rect") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                if (sscanf(argv[++i], "%d,%d,%d,%d", &options.rect_x, &options.rect_y, &options.rect_width, &options.rect_height) != 4)
+                {
+                    fprintf(stderr, "Error: --rect expects x,y,w,h\n");
+                    return 1;
+                }
+                // Bounded like the GS transfer registers: 11-bit TRXPOS origin,
+                // 12-bit TRXREG size, so x + w and y + h can never overflow
+                if (options.rect_x < 0 || options.rect_y < 0 || options.rect_x > 2047 || options.rect_y > 2047)
+                {
+                    fprintf(stderr, "Error: Rect origin must be from 0 to 2047\n");
+                    return 1;
+                }
+                if (options.rect_width <= 0 || options.rect_height <= 0 || options.rect_width > 4095 || options.rect_height > 4095)
+                {
+                    fprintf(stderr, "Error: Rect width and height must be from 1 to 4095\n");
+                    return 1;
+                }
+                options.has_rect = true;
+            }
+            else
+            {
+                fprintf(stderr, "Error: --rect requires an argument\n");
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--cbp") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                char* end;
+                unsigned long cbp = strtoul(argv[++i], &end, 0);
+                if (*end != '\0' || cbp > 0x3FFF)
+                {
+                    fprintf(stderr, "Error: CLUT base pointer must be a block number from 0 to 0x3FFF\n");
+                    return 1;
+                }
+                options.cbp = static_cast<u32>(cbp);
+                options.has_clut = true;
+            }
+            else
+            {
+                fprintf(stderr, "Error: --cbp requires an argument\n");
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--cpsm") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                if (!FindPsm(argv[++i], &options.cpsm) || (options.cpsm != PSMCT32 && options.cpsm != PSMCT16 && options.cpsm != PSMCT16S))
+                {
+                    fprintf(stderr, "Error: CLUT format must be ct32, ct16 or ct16s\n");
+                    return 1;
+                }
+            }
+            else
+            {
+                fprintf(stderr, "Error: --cpsm requires an argument\n");
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--csm") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                i++;
+                if (strcmp(argv[i], "1") == 0 || strcasecmp(argv[i], "csm1") == 0)
+                    options.csm = 0;
+                else if (strcmp(argv[i], "2") == 0 || strcasecmp(argv[i], "csm2") == 0)
+                    options.csm = 1;
+                else
+                {
+                    fprintf(stderr, "Error: CLUT storage mode must be 1 or 2\n");
+                    return 1;
+                }
+            }
+            else
+            {
+                fprintf(stderr, "Error: --csm requires an argument\n");
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--expand-clut") == 0)
+        {
+            options.expand_clut = true;
+        }
+        else if (strcmp(argv[i], "--width-sweep") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                if (first_option != 3 || !ParseWidthRange(argv[++i], &sweep_widths))
+                {
+                    fprintf(stderr, "Error: --width-sweep expects a range like 64..2048 and a single input\n");
+                    return 1;
+                }
+                width_sweep = true;
+            }
+            else
+            {
+                fprintf(stderr, "Error: --width-sweep requires an argument\n");
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--contact-sheet") == 0)
+        {
+            contact_sheet = true;
+        }
+        else if (strcmp(argv[i], "--frames") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                if (!replay_mode || !ParseFrameList(argv[++i], &frames))
+                {
+                    fprintf(stderr, "Error: --frames expects a list like 0,5,10-20 and needs --replay\n");
+                    return 1;
+                }
+            }
+            else
+            {
+                fprintf(stderr, "Error: --frames requires an argument\n");
+                return 1;
+            }
+        }
         else if (strcmp(argv[i], "--force-alpha") == 0)
         {
-            force_alpha = true;
+            options.force_alpha = true;
+        }
+        else if (strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "--threads") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                thread_count = atoi(argv[++i]);
+                if (thread_count < 0)
+                {
+                    fprintf(stderr, "Error: Thread count must not be negative\n");
+                    return 1;
+                }
+            }
+            else
+            {
+                fprintf(stderr, "Error: --threads requires an argument\n");
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--load") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                const char* mode = argv[++i];
+                if (strcmp(mode, "mmap") == 0)
+                    options.load_mode = GSDumpLoadMode::Map;
+                else if (strcmp(mode, "read") == 0)
+                    options.load_mode = GSDumpLoadMode::Read;
+                else
+                {
+                    fprintf(stderr, "Error: Unknown load mode: %s\n", mode);
+                    return 1;
+                }
+            }
+            else
+            {
+                fprintf(stderr, "Error: --load requires an argument\n");
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--format") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                if (!FindImageFormat(argv[++i], &options.format))
+                {
+                    fprintf(stderr, "Error: Unknown output format: %s\n", argv[i]);
+                    return 1;
+                }
+            }
+            else
+            {
+                fprintf(stderr, "Error: --format requires an argument\n");
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--tile-order") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                if (!FindTileOrder(argv[++i], &options.tile_order))
+                {
+                    fprintf(stderr, "Error: Unknown tile order: %s\n", argv[i]);
+                    return 1;
+                }
+            }
+            else
+            {
+                fprintf(stderr, "Error: --tile-order requires an argument\n");
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--png-speed") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                const char* speed = argv[++i];
+                if (strcmp(speed, "fast") == 0)
+                    options.png_speed = PngSpeed::Fast;
+                else if (strcmp(speed, "balanced") == 0)
+                    options.png_speed = PngSpeed::Balanced;
+                else if (strcmp(speed, "max") == 0)
+                    options.png_speed = PngSpeed::Max;
+                else
+                {
+                    fprintf(stderr, "Error: Unknown PNG speed: %s\n", speed);
+                    return 1;
+                }
+            }
+            else
+            {
+                fprintf(stderr, "Error: --png-speed requires an argument\n");
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--cache") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                options.cache_dir = argv[++i];
+            }
+            else
+            {
+                fprintf(stderr, "Error: --cache requires an argument\n");
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--huge-pages") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                HugePages huge_pages;
+                if (!FindHugePages(argv[++i], &huge_pages))
+                {
+                    fprintf(stderr, "Error: Huge pages must be off, thp or explicit\n");
+                    return 1;
+                }
+                SetHugePages(huge_pages);
+            }
+            else
+            {
+                fprintf(stderr, "Error: --huge-pages requires an argument\n");
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--numa") == 0)
+        {
+            options.numa_local = true;
+        }
+        else if (strcmp(argv[i], "--stats") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                const char* format = argv[++i];
+                if (strcmp(format, "text") == 0)
+                    stats_format = StatsFormat::Text;
+                else if (strcmp(format, "json") == 0)
+                    stats_format = StatsFormat::Json;
+                else
+                {
+                    fprintf(stderr, "Error: Unknown stats format: %s\n", format);
+                    return 1;
+                }
+            }
+            else
+            {
+                fprintf(stderr, "Error: --stats requires an argument\n");
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--stats-file") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                stats_file = argv[++i];
+            }
+            else
+            {
+                fprintf(stderr, "Error: --stats-file requires an argument\n");
+                return 1;
+            }
         }
         else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0)
         {
@@ -81,76 +506,197 @@ int main(int argc, char** argv)
         }
     }
 
-    // Open GS dump file
-    printf("Reading VRAM from: %s\n", input_file);
+    // 8-bit and 4-bit pages are 128 pixels wide
+    const int page_width = GetPsmPageWidth(options.psm);
+    if (options.vram_width % page_width != 0)
+    {
+        fprintf(stderr, "Error: Width must be a multiple of %d for %s\n", page_width, GetPsmName(options.psm));
+        return 1;
+    }
 
-    GSDumpFile dump;
-    if (!dump.Open(input_file))
+    if (contact_sheet && !width_sweep)
     {
-        fprintf(stderr, "Error: Failed to open GS dump file: %s\n", input_file);
+        fprintf(stderr, "Error: --contact-sheet needs --width-sweep\n");
+        return 1;
+    }
+
+    // Only the single output file names its format; the other modes need --format
+    const bool single_output = !batch_mode && !replay_mode && !watch_mode && !png2gs_mode && !width_sweep;
+    if (options.tile_order != TileOrder::Linear &&
+        (ResolveImageFormat(options.format, single_output ? output_file : "") != ImageFormat::Raw || contact_sheet))
+    {
+        fprintf(stderr, "Error: --tile-order needs raw output (.rgba or --format rgba) and no --contact-sheet\n");
+        return 1;
+    }
+
+    if (width_sweep && (sweep_widths.last / page_width) * page_width < sweep_widths.first)
+    {
+        fprintf(stderr, "Error: Width range has no multiple of %d for %s\n", page_width, GetPsmName(options.psm));
+        return 1;
+    }
+
+    // The GS only reads CSM2 CLUTs in PSMCT16
+    if (options.csm == 1 && options.cpsm != PSMCT16)
+    {
+        fprintf(stderr, "Error: --csm 2 requires --cpsm ct16\n");
         return 1;
     }
 
-    printf("VRAM loaded successfully\n");
+    if (options.detect_region && options.has_rect)
+    {
+        fprintf(stderr, "Error: --bp auto picks the rect itself and cannot take --rect\n");
+        return 1;
+    }
 
-    // VRAM parameters
-    constexpr u32 VRAM_SIZE = 4 * 1024 * 1024;
-    constexpr u32 BYTES_PER_PIXEL = 4;
-    const u32 total_pixels = VRAM_SIZE / BYTES_PER_PIXEL;
+    if ((options.detect_width || options.detect_region) && (width_sweep || png2gs_mode))
+    {
+        fprintf(stderr, "Error: -w auto and --bp auto cannot be used with --width-sweep or --png2gs\n");
+        return 1;
+    }
 
-    // Calculate buffer width and image dimensions
-    const u32 buffer_width = vram_width / 64;
-    const int height = total_pixels / vram_width;
+    if (options.has_clut && !IsIndexedPsm(options.psm))
+    {
+        fprintf(stderr, "Error: --cbp needs an index format (t8, t4, t8h, t4hl or t4hh)\n");
+        return 1;
+    }
 
-    printf("VRAM buffer width: %d pixels (%u units)\n", vram_width, buffer_width);
-    printf("Image dimensions: %dx%d\n", vram_width, height);
-    if (force_alpha)
-        printf("Alpha channel: Forced to 255\n");
+    if (options.cache_dir && mkdir(options.cache_dir, 0777) != 0 && errno != EEXIST)
+    {
+        fprintf(stderr, "Error: Failed to create cache directory: %s\n", options.cache_dir);
+        return 1;
+    }
 
-    // Allocate output image buffer (RGBA)
-    std::vector<u8> image(vram_width * height * 4);
+    if (stats_file && stats_format == StatsFormat::None)
+        stats_format = StatsFormat::Json;
 
-    // Deswizzle VRAM to image
-    printf("Deswizzling VRAM...\n");
+    StatsReport stats;
+    if (!stats.Open(stats_format, stats_file))
+    {
+        fprintf(stderr, "Error: Failed to create stats file: %s\n", stats_file);
+        return 1;
+    }
 
-    const u8* vram = dump.GetVRAM();
+    if (replay_mode)
+    {
+        int failures = RunReplay(input_file, output_file, options, frames, thread_count, stats);
+        if (failures < 0)
+        {
+            fprintf(stderr, "Error: Failed to replay GS dump file: %s\n", input_file);
+            return 1;
+        }
+        return failures == 0 ? 0 : 1;
+    }
 
-    // Read VRAM with specified buffer width
-    for (int y = 0; y < height; y++)
+    if (png2gs_mode)
     {
-        for (int x = 0; x < vram_width; x++)
+        printf("Writing %s into VRAM of: %s\n", input_file, output_file);
+
+        ConvertStats convert_stats;
+        if (!PatchDump(input_file, output_file, options, &convert_stats))
         {
-            // Read pixel from swizzled VRAM
-            u32 pixel = ReadPixel32(vram, x, y, 0, buffer_width);
+            fprintf(stderr, "Error: Failed to patch GS dump file: %s\n", output_file);
+            return 1;
+        }
+
+        printf("Successfully patched VRAM\n");
+        stats.AddFile(input_file, output_file, -1, true, convert_stats);
+        return 0;
+    }
 
-            // Extract RGBA components
-            u8 r = (pixel >> 0) & 0xFF;
-            u8 g = (pixel >> 8) & 0xFF;
-            u8 b = (pixel >> 16) & 0xFF;
-            u8 a = (pixel >> 24) & 0xFF;
+    if (watch_mode)
+    {
+        int failures = RunWatch(input_file, output_file, options, thread_count, stats);
+        if (failures < 0)
+        {
+            fprintf(stderr, "Error: Failed to watch directory: %s\n", input_file);
+            return 1;
+        }
+        return failures == 0 ? 0 : 1;
+    }
 
-            // Force alpha if requested
-            if (force_alpha) a = 255;
+    if (batch_mode)
+    {
+        int failures = RunBatch(input_file, output_file, options, thread_count, stats);
+        if (failures < 0)
+        {
+            fprintf(stderr, "Error: Failed to read batch source: %s\n", input_file);
+            return 1;
+        }
+        return failures == 0 ? 0 : 1;
+    }
 
-            // Write to output buffer
-            int out_index = (y * vram_width + x) * 4;
-            image[out_index + 0] = r;
-            image[out_index + 1] = g;
-            image[out_index + 2] = b;
-            image[out_index + 3] = a;
+    if (width_sweep)
+    {
+        printf("Reading VRAM from: %s\n", input_file);
+        int failures = RunWidthSweep(input_file, output_file, options, sweep_widths, contact_sheet, thread_count, stats);
+        if (failures < 0)
+        {
+            fprintf(stderr, "Error: Failed to open GS dump file: %s\n", input_file);
+            return 1;
         }
+        return failures == 0 ? 0 : 1;
+    }
+
+    options.format = ResolveImageFormat(options.format, output_file);
+
+    // Progress goes to stderr when the image goes to stdout
+    FILE* log = IsStdoutPath(output_file) ? stderr : stdout;
+
+    // Open GS dump file
+    fprintf(log, "Reading VRAM from: %s\n", strcmp(input_file, "-") == 0 ? "standard input" : input_file);
+
+    Converter converter;
+    if (!converter.Load(input_file, options))
+    {
+        fprintf(stderr, "Error: Failed to open GS dump file: %s\n", input_file);
+        return 1;
     }
 
-    // Write PNG
-    printf("Writing PNG to: %s\n", output_file);
+    fprintf(log, "VRAM loaded successfully (%s)\n", converter.GetDump().IsMapped() ? "mapped" : "read");
+
+    const bool detect_layout = options.detect_width || options.detect_region;
+    int image_width, image_height;
+    Converter::GetImageSize(options, &image_width, &image_height);
+
+    if (options.detect_width)
+        fprintf(log, "VRAM buffer width: auto\n");
+    else
+        fprintf(log, "VRAM buffer width: %d pixels (%u units)\n", options.vram_width, options.vram_width / 64);
+    if (options.psm != PSMCT32)
+        fprintf(log, "Pixel format: %s\n", GetPsmName(options.psm));
+    if (options.detect_region)
+        fprintf(log, "Base pointer: auto\n");
+    else if (options.bp != 0)
+        fprintf(log, "Base pointer: 0x%X\n", options.bp);
+    if (options.has_rect)
+        fprintf(log, "Region: %d,%d\n", options.rect_x, options.rect_y);
+    if (options.has_clut)
+        fprintf(log, "CLUT: 0x%X (%s, CSM%u)\n", options.cbp, GetPsmName(options.cpsm), options.csm + 1);
+    if (!detect_layout)
+        fprintf(log, "Image dimensions: %dx%d\n", image_width, image_height);
+    if (options.force_alpha)
+        fprintf(log, "Alpha channel: Forced to 255\n");
 
-    if (!stbi_write_png(output_file, vram_width, height, 4, image.data(), vram_width * 4))
+    // Deswizzle VRAM to image and write the PNG (or reuse a cached one)
+    ThreadPool pool(thread_count);
+    fprintf(log, "Deswizzling VRAM (%s, %d threads)...\n", GetDeswizzleKernelName(), pool.GetThreadCount());
+    fprintf(log, "Writing %s to: %s\n", GetImageFormatName(options.format), output_file);
+
+    if (!converter.Save(output_file, options, &pool))
     {
-        fprintf(stderr, "Error: Failed to write PNG file: %s\n", output_file);
+        fprintf(stderr, "Error: Failed to write output file: %s\n", output_file);
         return 1;
     }
 
-    printf("Successfully saved PNG\n");
+    if (detect_layout && !converter.GetStats().cache_hits)
+    {
+        const ConvertOptions& layout = converter.GetLayout();
+        fprintf(log, "Detected layout: %d pixels wide at 0x%X, image %dx%d\n", layout.vram_width, layout.bp,
+            converter.GetWidth(), converter.GetHeight());
+    }
+
+    fprintf(log, converter.GetStats().cache_hits ? "Reused cached %s\n" : "Successfully saved %s\n", GetImageFormatName(options.format));
+    stats.AddFile(input_file, output_file, -1, true, converter.GetStats());
 
     return 0;
 }
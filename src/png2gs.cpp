@@ -0,0 +1,115 @@
+// PNG to VRAM conversion implementation
+#include "png2gs.h"
+#include "gsdump.h"
+#include "gsswizzle.h"
+
+#include <cstdio>
+#include <vector>
+
+// CLUT indices of a palette image, or the levels of a gray one (r = g = b)
+static bool GetIndices(const PngImage& image, int entries, std::vector<u8>* indices)
+{
+    const size_t pixels = static_cast<size_t>(image.width) * image.height;
+    if (image.palette_size)
+    {
+        for (size_t i = 0; i < pixels; i++)
+        {
+            if (image.indices[i] >= entries)
+            {
+                fprintf(stderr, "Error: PNG uses palette index %d, but the format has %d CLUT entries\n", image.indices[i], entries);
+                return false;
+            }
+        }
+        *indices = image.indices;
+        return true;
+    }
+
+    indices->resize(pixels);
+    for (size_t i = 0; i < pixels; i++)
+    {
+        const u8* pixel = &image.rgba[i * 4];
+        if (pixel[0] != pixel[1] || pixel[0] != pixel[2])
+        {
+            fprintf(stderr, "Error: Index formats need a palette or grayscale PNG\n");
+            return false;
+        }
+
+        // 4-bit gray levels are written as i * 17 when there is no CLUT
+        (*indices)[i] = entries == 16 ? pixel[0] >> 4 : pixel[0];
+    }
+    return true;
+}
+
+bool SwizzleImage(u8* vram, const PngImage& image, const ConvertOptions& options)
+{
+    if (options.has_rect && (options.rect_width != image.width || options.rect_height != image.height))
+    {
+        fprintf(stderr, "Error: PNG is %dx%d but the rect is %dx%d\n", image.width, image.height, options.rect_width, options.rect_height);
+        return false;
+    }
+
+    // Rows wrap around VRAM like the GS does, but must stay within the buffer width
+    const int x = options.has_rect ? options.rect_x : 0;
+    const int y = options.has_rect ? options.rect_y : 0;
+    if (x + image.width > options.vram_width)
+    {
+        fprintf(stderr, "Error: PNG is %d pixels wide, which does not fit at x = %d in a %d pixel wide buffer\n", image.width, x, options.vram_width);
+        return false;
+    }
+
+    const u32 buffer_width = options.vram_width / 64;
+    if (!IsIndexedPsm(options.psm))
+        return SwizzleRect(vram, image.rgba.data(), x, y, image.width, image.height, options.bp, buffer_width, options.psm);
+
+    const int entries = GetClutEntryCount(options.psm);
+    std::vector<u8> indices;
+    if (!GetIndices(image, entries, &indices))
+        return false;
+
+    if (options.has_clut)
+    {
+        if (!image.palette_size)
+        {
+            fprintf(stderr, "Error: --cbp needs a palette PNG\n");
+            return false;
+        }
+
+        // Entries past the end of the PNG palette keep their current colors
+        u32 palette[256];
+        ReadClut(vram, options.cbp, options.cpsm, options.csm, options.psm, false, palette);
+        for (int i = 0; i < image.palette_size && i < entries; i++)
+            palette[i] = image.palette[i];
+        WriteClut(vram, options.cbp, options.cpsm, options.csm, options.psm, palette);
+    }
+
+    return SwizzleIndexRect(vram, indices.data(), x, y, image.width, image.height, options.bp, buffer_width, options.psm);
+}
+
+bool PatchDump(const char* png_file, const char* dump_file, const ConvertOptions& options, ConvertStats* stats)
+{
+    ConvertStats local_stats;
+    if (!stats)
+        stats = &local_stats;
+
+    PngImage image;
+    GSDumpFile dump;
+    {
+        ScopedTimer timer(&stats->load_seconds);
+        if (!ReadPNG(png_file, &image))
+            return false;
+
+        if (!dump.Open(dump_file, GSDumpLoadMode::Patch))
+            return false;
+    }
+
+    {
+        ScopedTimer timer(&stats->deswizzle_seconds);
+        if (!SwizzleImage(dump.GetMutableVRAM(), image, options))
+            return false;
+        stats->pixels += static_cast<u64>(image.width) * image.height;
+    }
+
+    ScopedTimer timer(&stats->write_seconds);
+    dump.Close();
+    return true;
+}
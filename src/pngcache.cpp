@@ -0,0 +1,82 @@
+// PNG cache implementation
+#include "pngcache.h"
+#include "hash.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+static const size_t VRAM_SIZE = 4 * 1024 * 1024;
+
+u64 GetPngCacheKey(const u8* vram, const ConvertOptions& options)
+{
+    // The PNG bytes also depend on the compression level
+    const u64 seed = HashConvertOptions(options) + static_cast<u64>(options.png_speed);
+    return HashBytes(vram, VRAM_SIZE, seed);
+}
+
+// The key covers the output format, and the entry is named for it too
+static std::string GetCachePath(const char* cache_dir, u64 key, const char* output_file)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llx", static_cast<unsigned long long>(key));
+    return std::string(cache_dir) + name + GetImageFormatExtension(GetImageFormatFromPath(output_file));
+}
+
+// Copy through a temporary file renamed into place, so readers never see a partial PNG
+static bool CopyFile(const char* source, const char* target)
+{
+    FILE* in = fopen(source, "rb");
+    if (!in)
+        return false;
+
+    const std::string temp_path = std::string(target) + ".tmp";
+    FILE* out = fopen(temp_path.c_str(), "wb");
+    if (!out)
+    {
+        fclose(in);
+        return false;
+    }
+
+    std::vector<u8> buffer(256 * 1024);
+    bool ok = true;
+    size_t count;
+    while (ok && (count = fread(buffer.data(), 1, buffer.size(), in)) > 0)
+        ok = fwrite(buffer.data(), 1, count, out) == count;
+    ok = ok && !ferror(in);
+
+    fclose(in);
+    ok = fclose(out) == 0 && ok && rename(temp_path.c_str(), target) == 0;
+    if (!ok)
+        unlink(temp_path.c_str());
+    return ok;
+}
+
+// Make target a link to (or copy of) source
+static bool LinkOrCopy(const char* source, const char* target)
+{
+    if (link(source, target) == 0)
+        return true;
+    return errno != EEXIST && CopyFile(source, target);
+}
+
+bool FetchCachedPng(const char* cache_dir, u64 key, const char* output_file)
+{
+    const std::string cache_path = GetCachePath(cache_dir, key, output_file);
+    struct stat st;
+    if (stat(cache_path.c_str(), &st) != 0)
+        return false;
+
+    // Replace whatever output_file was, rather than writing into it
+    unlink(output_file);
+    return LinkOrCopy(cache_path.c_str(), output_file);
+}
+
+void StoreCachedPng(const char* cache_dir, u64 key, const char* output_file)
+{
+    const std::string cache_path = GetCachePath(cache_dir, key, output_file);
+    LinkOrCopy(output_file, cache_path.c_str());
+}
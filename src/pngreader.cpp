@@ -0,0 +1,273 @@
+// PNG decoder implementation
+#include "pngreader.h"
+#include "deflate.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// Largest image accepted; VRAM holds at most 8M 4-bit pixels
+static const u64 MAX_PIXELS = 64ull * 1024 * 1024;
+
+static u32 GetU32BE(const u8* p)
+{
+    return (static_cast<u32>(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static u8 Paeth(int a, int b, int c)
+{
+    int p = a + b - c, pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    if (pa <= pb && pa <= pc) return static_cast<u8>(a);
+    if (pb <= pc) return static_cast<u8>(b);
+    return static_cast<u8>(c);
+}
+
+// Undo the filter of each row in place; data holds a filter byte before every row
+static bool Unfilter(u8* data, int height, size_t row_bytes, int pixel_bytes)
+{
+    const u8* prev = nullptr;
+    for (int y = 0; y < height; y++)
+    {
+        u8* row = data + y * (row_bytes + 1);
+        const int filter = row[0];
+        row++;
+
+        for (size_t i = 0; i < row_bytes; i++)
+        {
+            const int a = i >= static_cast<size_t>(pixel_bytes) ? row[i - pixel_bytes] : 0;
+            const int b = prev ? prev[i] : 0;
+            const int c = prev && i >= static_cast<size_t>(pixel_bytes) ? prev[i - pixel_bytes] : 0;
+            switch (filter)
+            {
+            case 0: break;
+            case 1: row[i] = static_cast<u8>(row[i] + a); break;
+            case 2: row[i] = static_cast<u8>(row[i] + b); break;
+            case 3: row[i] = static_cast<u8>(row[i] + ((a + b) >> 1)); break;
+            case 4: row[i] = static_cast<u8>(row[i] + Paeth(a, b, c)); break;
+            default: return false;
+            }
+        }
+        prev = row;
+    }
+    return true;
+}
+
+// Sample n of a row at the given bit depth (16-bit samples in full)
+static inline u32 GetSample(const u8* row, size_t n, int depth)
+{
+    switch (depth)
+    {
+    case 16: return (row[n * 2] << 8) | row[n * 2 + 1];
+    case 8:  return row[n];
+    default:
+    {
+        // Sub-byte samples are packed high bits first
+        const size_t bit = n * depth;
+        return (row[bit >> 3] >> (8 - depth - (bit & 7))) & ((1 << depth) - 1);
+    }
+    }
+}
+
+bool DecodePNG(const u8* data, size_t size, PngImage* image)
+{
+    static const u8 signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    if (size < 8 || memcmp(data, signature, 8) != 0)
+    {
+        fprintf(stderr, "Error: Not a PNG file\n");
+        return false;
+    }
+
+    int depth = 0, color_type = -1, interlace = 0;
+    u32 width = 0, height = 0;
+    std::vector<u8> idat;
+    u32 palette_alpha[256];
+    bool has_key = false;
+    u32 key[3] = {};
+
+    image->palette_size = 0;
+    for (u32& alpha : palette_alpha)
+        alpha = 0xFF;
+
+    size_t pos = 8;
+    bool seen_end = false;
+    while (!seen_end && pos + 12 <= size)
+    {
+        const u32 length = GetU32BE(data + pos);
+        const u8* type = data + pos + 4;
+        const u8* body = data + pos + 8;
+        if (length > size - pos - 12)
+            break;
+
+        if (memcmp(type, "IHDR", 4) == 0 && length >= 13)
+        {
+            width = GetU32BE(body);
+            height = GetU32BE(body + 4);
+            depth = body[8];
+            color_type = body[9];
+            interlace = body[12];
+        }
+        else if (memcmp(type, "PLTE", 4) == 0)
+        {
+            image->palette_size = static_cast<int>(length / 3 > 256 ? 256 : length / 3);
+            for (int i = 0; i < image->palette_size; i++)
+                image->palette[i] = body[i * 3] | (body[i * 3 + 1] << 8) | (body[i * 3 + 2] << 16);
+        }
+        else if (memcmp(type, "tRNS", 4) == 0)
+        {
+            if (color_type == 3)
+            {
+                for (u32 i = 0; i < length && i < 256; i++)
+                    palette_alpha[i] = body[i];
+            }
+            else if ((color_type == 0 && length >= 2) || (color_type == 2 && length >= 6))
+            {
+                has_key = true;
+                for (u32 i = 0; i < length / 2 && i < 3; i++)
+                    key[i] = (body[i * 2] << 8) | body[i * 2 + 1];
+            }
+        }
+        else if (memcmp(type, "IDAT", 4) == 0)
+        {
+            idat.insert(idat.end(), body, body + length);
+        }
+        else if (memcmp(type, "IEND", 4) == 0)
+        {
+            seen_end = true;
+        }
+
+        pos += 12 + length;
+    }
+
+    // Channels per color type (0 gray, 2 RGB, 3 palette, 4 gray + alpha, 6 RGBA)
+    static const int channel_counts[7] = { 1, 0, 3, 1, 2, 0, 4 };
+    const int channels = color_type >= 0 && color_type <= 6 ? channel_counts[color_type] : 0;
+    const bool valid_depth =
+        (color_type == 0 && (depth == 1 || depth == 2 || depth == 4 || depth == 8 || depth == 16)) ||
+        (color_type == 3 && (depth == 1 || depth == 2 || depth == 4 || depth == 8)) ||
+        ((color_type == 2 || color_type == 4 || color_type == 6) && (depth == 8 || depth == 16));
+
+    if (width == 0 || height == 0 || channels == 0 || !valid_depth)
+    {
+        fprintf(stderr, "Error: Missing or unsupported PNG header\n");
+        return false;
+    }
+    if (interlace != 0)
+    {
+        fprintf(stderr, "Error: Interlaced PNGs are not supported\n");
+        return false;
+    }
+    if (static_cast<u64>(width) * height > MAX_PIXELS)
+    {
+        fprintf(stderr, "Error: PNG is too large (%ux%u)\n", width, height);
+        return false;
+    }
+    if (color_type == 3 && image->palette_size == 0)
+    {
+        fprintf(stderr, "Error: Palette PNG without a PLTE chunk\n");
+        return false;
+    }
+
+    const size_t row_bytes = (static_cast<size_t>(width) * channels * depth + 7) / 8;
+    const int pixel_bytes = channels * depth >= 8 ? channels * depth / 8 : 1;
+
+    std::vector<u8> raw;
+    raw.reserve((row_bytes + 1) * height);
+    if (!ZlibDecompress(idat.data(), idat.size(), &raw) || raw.size() < (row_bytes + 1) * height ||
+        !Unfilter(raw.data(), static_cast<int>(height), row_bytes, pixel_bytes))
+    {
+        fprintf(stderr, "Error: Corrupt PNG image data\n");
+        return false;
+    }
+
+    // RGB images may carry a suggested palette; it is not used
+    if (color_type != 3)
+        image->palette_size = 0;
+    for (int i = 0; i < image->palette_size; i++)
+        image->palette[i] |= palette_alpha[i] << 24;
+
+    image->width = static_cast<int>(width);
+    image->height = static_cast<int>(height);
+    image->rgba.resize(static_cast<size_t>(width) * height * 4);
+    image->indices.clear();
+    if (color_type == 3)
+        image->indices.resize(static_cast<size_t>(width) * height);
+
+    // Scale gray samples below 8 bits up to the full range
+    const u32 gray_scale = depth < 8 ? 255 / ((1 << depth) - 1) : 1;
+    const int shift = depth == 16 ? 8 : 0;
+
+    for (u32 y = 0; y < height; y++)
+    {
+        const u8* row = raw.data() + y * (row_bytes + 1) + 1;
+        u32* dst = reinterpret_cast<u32*>(image->rgba.data()) + static_cast<size_t>(y) * width;
+
+        for (u32 x = 0; x < width; x++)
+        {
+            u32 color;
+            switch (color_type)
+            {
+            case 0:
+            {
+                const u32 v = GetSample(row, x, depth);
+                const u32 g = depth < 8 ? v * gray_scale : v >> shift;
+                const u32 a = has_key && v == key[0] ? 0 : 0xFF;
+                color = g | (g << 8) | (g << 16) | (a << 24);
+                break;
+            }
+            case 2:
+            {
+                const u32 r = GetSample(row, x * 3 + 0, depth);
+                const u32 g = GetSample(row, x * 3 + 1, depth);
+                const u32 b = GetSample(row, x * 3 + 2, depth);
+                const u32 a = has_key && r == key[0] && g == key[1] && b == key[2] ? 0 : 0xFF;
+                color = (r >> shift) | ((g >> shift) << 8) | ((b >> shift) << 16) | (a << 24);
+                break;
+            }
+            case 3:
+            {
+                const u32 index = GetSample(row, x, depth);
+                image->indices[static_cast<size_t>(y) * width + x] = static_cast<u8>(index);
+                color = static_cast<int>(index) < image->palette_size ? image->palette[index] : 0;
+                break;
+            }
+            case 4:
+            {
+                const u32 g = GetSample(row, x * 2 + 0, depth) >> shift;
+                const u32 a = GetSample(row, x * 2 + 1, depth) >> shift;
+                color = g | (g << 8) | (g << 16) | (a << 24);
+                break;
+            }
+            default:
+            {
+                const u32 r = GetSample(row, x * 4 + 0, depth) >> shift;
+                const u32 g = GetSample(row, x * 4 + 1, depth) >> shift;
+                const u32 b = GetSample(row, x * 4 + 2, depth) >> shift;
+                const u32 a = GetSample(row, x * 4 + 3, depth) >> shift;
+                color = r | (g << 8) | (b << 16) | (a << 24);
+                break;
+            }
+            }
+            dst[x] = color;
+        }
+    }
+    return true;
+}
+
+bool ReadPNG(const char* filename, PngImage* image)
+{
+    FILE* fp = fopen(filename, "rb");
+    if (!fp)
+    {
+        fprintf(stderr, "Error: Cannot open %s\n", filename);
+        return false;
+    }
+
+    std::vector<u8> data;
+    u8 buffer[64 * 1024];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+        data.insert(data.end(), buffer, buffer + count);
+    fclose(fp);
+
+    return DecodePNG(data.data(), data.size(), image);
+}
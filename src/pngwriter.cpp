@@ -0,0 +1,561 @@
+// Multithreaded PNG encoder implementation
+#include "pngwriter.h"
+#include "deflate.h"
+#include "threadpool.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+
+// Filtered bytes per strip; fixed so the output is identical for any thread count
+static const size_t STRIP_BYTES = 256 * 1024;
+
+// Same default as stbi_write_png_compression_level
+static const int COMPRESSION_LEVEL = 8;
+
+// Filtered data kept before each streamed strip, as the deflate match window
+static const size_t WINDOW_BYTES = 32768;
+
+// Filter used by PngSpeed::Fast for every row (Up: cheap, and flat areas become zero runs)
+static const int FAST_FILTER = 2;
+
+struct CrcTable
+{
+    u32 entries[256];
+
+    CrcTable()
+    {
+        for (u32 n = 0; n < 256; n++)
+        {
+            u32 c = n;
+            for (int k = 0; k < 8; k++)
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            entries[n] = c;
+        }
+    }
+};
+
+static u32 Crc32(const u8* data, size_t len)
+{
+    static const CrcTable table;
+    u32 crc = ~0u;
+    for (size_t i = 0; i < len; i++)
+        crc = table.entries[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static void PutU32BE(std::vector<u8>* out, u32 value)
+{
+    out->push_back(static_cast<u8>(value >> 24));
+    out->push_back(static_cast<u8>(value >> 16));
+    out->push_back(static_cast<u8>(value >> 8));
+    out->push_back(static_cast<u8>(value));
+}
+
+// Start a chunk; returns the offset to hand to EndChunk
+static size_t BeginChunk(std::vector<u8>* out, const char* type)
+{
+    size_t offset = out->size();
+    PutU32BE(out, 0);
+    out->insert(out->end(), type, type + 4);
+    return offset;
+}
+
+// Patch the length and append the CRC of type + data
+static void EndChunk(std::vector<u8>* out, size_t offset)
+{
+    u32 length = static_cast<u32>(out->size() - offset - 8);
+    u8* p = out->data() + offset;
+    p[0] = static_cast<u8>(length >> 24);
+    p[1] = static_cast<u8>(length >> 16);
+    p[2] = static_cast<u8>(length >> 8);
+    p[3] = static_cast<u8>(length);
+    PutU32BE(out, Crc32(out->data() + offset + 4, length + 4));
+}
+
+static u8 Paeth(int a, int b, int c)
+{
+    int p = a + b - c, pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    if (pa <= pb && pa <= pc) return static_cast<u8>(a);
+    if (pb <= pc) return static_cast<u8>(b);
+    return static_cast<u8>(c);
+}
+
+// n is the filter distance: bytes per pixel, or 1 for packed indices
+static void FilterRow(const u8* z, const u8* prev, int row_bytes, int n, int type, u8* out)
+{
+    switch (type)
+    {
+    case 0: memcpy(out, z, row_bytes); break;
+    case 1:
+        memcpy(out, z, n);
+        for (int i = n; i < row_bytes; i++) out[i] = z[i] - z[i - n];
+        break;
+    case 2:
+        for (int i = 0; i < row_bytes; i++) out[i] = z[i] - prev[i];
+        break;
+    case 3:
+        for (int i = 0; i < n; i++) out[i] = z[i] - (prev[i] >> 1);
+        for (int i = n; i < row_bytes; i++) out[i] = z[i] - ((z[i - n] + prev[i]) >> 1);
+        break;
+    case 4:
+        for (int i = 0; i < n; i++) out[i] = z[i] - Paeth(0, prev[i], 0);
+        for (int i = n; i < row_bytes; i++) out[i] = z[i] - Paeth(z[i - n], prev[i], prev[i - n]);
+        break;
+    }
+}
+
+// Pick the filter with the smallest sum of absolute signed residuals, as stb does
+static void EncodeRow(const u8* z, const u8* prev, int row_bytes, int n, u8* out, u8* scratch)
+{
+    int best_type = 0;
+    int best_estimate = 0x7FFFFFFF;
+    for (int type = 0; type < 5; type++)
+    {
+        u8* line = type == 0 ? out + 1 : scratch;
+        FilterRow(z, prev, row_bytes, n, type, line);
+
+        int estimate = 0;
+        for (int i = 0; i < row_bytes; i++)
+            estimate += abs(static_cast<signed char>(line[i]));
+
+        if (estimate < best_estimate)
+        {
+            best_estimate = estimate;
+            best_type = type;
+            if (type != 0)
+                memcpy(out + 1, scratch, row_bytes);
+        }
+    }
+    out[0] = static_cast<u8>(best_type);
+}
+
+template <typename Func>
+static void ForEach(ThreadPool* pool, int count, const Func& func)
+{
+    if (pool)
+    {
+        pool->ParallelFor(count, func);
+        return;
+    }
+
+    for (int i = 0; i < count; i++)
+        func(i);
+}
+
+static bool EncodePNG_stb(const u8* rgba, int width, int height, int stride, std::vector<u8>* out)
+{
+    int len;
+    unsigned char* png = stbi_write_png_to_mem(rgba, stride, width, height, 4, &len);
+    if (!png)
+        return false;
+
+    out->assign(png, png + len);
+    STBIW_FREE(png);
+    return true;
+}
+
+// Filter and deflate height rows of row_bytes each into out as IDAT chunks.
+// fixed_filter < 0 picks a filter per row.
+void PngEncoder::EncodeIDAT(const u8* rows, int row_bytes, int height, int stride, int pixel_bytes, int fixed_filter, PngSpeed speed, ThreadPool* pool, std::vector<u8>* out)
+{
+    const size_t filt_stride = static_cast<size_t>(row_bytes) + 1;
+    const int strip_rows = static_cast<int>(STRIP_BYTES / filt_stride) > 0 ? static_cast<int>(STRIP_BYTES / filt_stride) : 1;
+    const int strip_count = (height + strip_rows - 1) / strip_rows;
+
+    // Filtering looks at the raw previous row only, so strips filter independently.
+    // Buffers only grow, so a warm encoder does not allocate.
+    std::vector<u8>& filt = m_filtered;
+    filt.resize(filt_stride * height);
+    m_zeroRow.assign(row_bytes, 0);
+    m_scratch.resize(static_cast<size_t>(row_bytes) * strip_count);
+    const u8* zero_row = m_zeroRow.data();
+
+    ForEach(pool, strip_count, [&](int s)
+    {
+        u8* scratch = m_scratch.data() + static_cast<size_t>(s) * row_bytes;
+        int y1 = (s + 1) * strip_rows < height ? (s + 1) * strip_rows : height;
+        for (int y = s * strip_rows; y < y1; y++)
+        {
+            const u8* prev = y > 0 ? rows + static_cast<size_t>(y - 1) * stride : zero_row;
+            const u8* row = rows + static_cast<size_t>(y) * stride;
+            u8* dst = filt.data() + y * filt_stride;
+            if (fixed_filter >= 0)
+            {
+                dst[0] = static_cast<u8>(fixed_filter);
+                FilterRow(row, prev, row_bytes, pixel_bytes, fixed_filter, dst + 1);
+            }
+            else
+            {
+                EncodeRow(row, prev, row_bytes, pixel_bytes, dst, scratch);
+            }
+        }
+    });
+
+    // Deflate each strip into its own IDAT chunk; the window reaches back into the previous strip
+    if (m_chunks.size() < static_cast<size_t>(strip_count))
+        m_chunks.resize(strip_count);
+    m_adlers.resize(strip_count);
+    std::vector<std::vector<u8>>& chunks = m_chunks;
+    std::vector<u32>& adlers = m_adlers;
+
+    ForEach(pool, strip_count, [&](int s)
+    {
+        size_t start = s * strip_rows * filt_stride;
+        size_t end = (s + 1) * strip_rows < height ? (s + 1) * strip_rows * filt_stride : filt.size();
+
+        std::vector<u8>& chunk = chunks[s];
+        chunk.clear();
+        chunk.reserve((end - start) / 2 + 64);
+        size_t offset = BeginChunk(&chunk, "IDAT");
+        if (s == 0)
+        {
+            // zlib header: DEFLATE 32K window, FLEVEL = 1
+            chunk.push_back(0x78);
+            chunk.push_back(0x5E);
+        }
+        if (speed == PngSpeed::Fast)
+            DeflateCompressChunkRLE(filt.data(), start, end, pixel_bytes, &chunk);
+        else
+            DeflateCompressChunk(filt.data(), start, end, COMPRESSION_LEVEL, &chunk);
+        EndChunk(&chunk, offset);
+
+        adlers[s] = Adler32(filt.data() + start, end - start);
+    });
+
+    u32 adler = adlers[0];
+    for (int s = 1; s < strip_count; s++)
+    {
+        size_t len = ((s + 1) * strip_rows < height ? strip_rows : height - s * strip_rows) * filt_stride;
+        adler = Adler32Combine(adler, adlers[s], len);
+    }
+
+    for (int s = 0; s < strip_count; s++)
+        out->insert(out->end(), chunks[s].begin(), chunks[s].end());
+
+    size_t offset = BeginChunk(out, "IDAT");
+    DeflateFinish(out);
+    PutU32BE(out, adler);
+    EndChunk(out, offset);
+}
+
+// Signature and IHDR
+static void BeginPNG(std::vector<u8>* out, int width, int height, int bit_depth, int color_type)
+{
+    static const u8 signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+    out->assign(signature, signature + 8);
+
+    size_t offset = BeginChunk(out, "IHDR");
+    PutU32BE(out, static_cast<u32>(width));
+    PutU32BE(out, static_cast<u32>(height));
+    out->push_back(static_cast<u8>(bit_depth));
+    out->push_back(static_cast<u8>(color_type));
+    out->push_back(0);  // compression
+    out->push_back(0);  // filter
+    out->push_back(0);  // interlace
+    EndChunk(out, offset);
+}
+
+static void EndPNG(std::vector<u8>* out)
+{
+    size_t offset = BeginChunk(out, "IEND");
+    EndChunk(out, offset);
+}
+
+// PLTE and, when any entry is not fully opaque, tRNS
+static void PutPalette(std::vector<u8>* out, const u32* palette, int palette_size)
+{
+    size_t offset = BeginChunk(out, "PLTE");
+    for (int i = 0; i < palette_size; i++)
+    {
+        out->push_back(static_cast<u8>(palette[i]));
+        out->push_back(static_cast<u8>(palette[i] >> 8));
+        out->push_back(static_cast<u8>(palette[i] >> 16));
+    }
+    EndChunk(out, offset);
+
+    // tRNS only runs up to the last entry that is not fully opaque
+    int alpha_count = palette_size;
+    while (alpha_count > 0 && (palette[alpha_count - 1] >> 24) == 0xFF)
+        alpha_count--;
+    if (alpha_count > 0)
+    {
+        offset = BeginChunk(out, "tRNS");
+        for (int i = 0; i < alpha_count; i++)
+            out->push_back(static_cast<u8>(palette[i] >> 24));
+        EndChunk(out, offset);
+    }
+}
+
+FILE* CreateOutputFile(const char* filename)
+{
+    // A duplicate of stdout, so callers close it like any file
+    if (IsStdoutPath(filename))
+    {
+        fflush(stdout);
+        int fd = dup(STDOUT_FILENO);
+        FILE* fp = fd >= 0 ? fdopen(fd, "wb") : nullptr;
+        if (!fp && fd >= 0)
+            close(fd);
+        return fp;
+    }
+
+    struct stat st;
+    if (stat(filename, &st) == 0 && S_ISREG(st.st_mode) && st.st_nlink > 1)
+        unlink(filename);
+
+    return fopen(filename, "wb");
+}
+
+bool PngEncoder::Encode(const u8* rgba, int width, int height, int stride, PngSpeed speed, ThreadPool* pool, std::vector<u8>* out)
+{
+    if (width <= 0 || height <= 0)
+        return false;
+
+    if (speed == PngSpeed::Max)
+        return EncodePNG_stb(rgba, width, height, stride, out);
+
+    BeginPNG(out, width, height, 8, 6);  // RGBA
+    EncodeIDAT(rgba, width * 4, height, stride, 4, speed == PngSpeed::Fast ? FAST_FILTER : -1, speed, pool, out);
+    EndPNG(out);
+    return true;
+}
+
+bool PngEncoder::EncodeIndexed(const u8* indices, int width, int height, int stride, const u32* palette, int palette_size, PngSpeed speed, ThreadPool* pool, std::vector<u8>* out)
+{
+    if (width <= 0 || height <= 0 || (palette_size != 16 && palette_size != 256))
+        return false;
+
+    // 16-entry palettes are stored as 4-bit samples, high nibble first
+    std::vector<u8>& packed = m_packed;
+    int bit_depth = 8;
+    if (palette_size == 16)
+    {
+        bit_depth = 4;
+        const int packed_stride = (width + 1) / 2;
+        packed.assign(static_cast<size_t>(packed_stride) * height, 0);
+        for (int y = 0; y < height; y++)
+        {
+            const u8* src = indices + static_cast<size_t>(y) * stride;
+            u8* dst = packed.data() + static_cast<size_t>(y) * packed_stride;
+            for (int x = 0; x < width; x++)
+                dst[x >> 1] |= (src[x] & 0xF) << ((x & 1) ? 0 : 4);
+        }
+        indices = packed.data();
+        stride = packed_stride;
+    }
+
+    BeginPNG(out, width, height, bit_depth, 3);  // palette
+    PutPalette(out, palette, palette_size);
+
+    // Predicting indices rarely helps, so rows are left unfiltered unless the
+    // run-length-only deflate needs Up to find repeats between rows
+    EncodeIDAT(indices, (width * bit_depth + 7) / 8, height, stride, 1, speed == PngSpeed::Fast ? FAST_FILTER : 0, speed, pool, out);
+    EndPNG(out);
+    return true;
+}
+
+bool EncodePNG(const u8* rgba, int width, int height, int stride, PngSpeed speed, ThreadPool* pool, std::vector<u8>* out)
+{
+    PngEncoder encoder;
+    return encoder.Encode(rgba, width, height, stride, speed, pool, out);
+}
+
+bool EncodeIndexedPNG(const u8* indices, int width, int height, int stride, const u32* palette, int palette_size, PngSpeed speed, ThreadPool* pool, std::vector<u8>* out)
+{
+    PngEncoder encoder;
+    return encoder.EncodeIndexed(indices, width, height, stride, palette, palette_size, speed, pool, out);
+}
+
+bool WritePNGFile(const char* filename, const std::vector<u8>& png)
+{
+    FILE* fp = CreateOutputFile(filename);
+    if (!fp)
+        return false;
+
+    bool result = fwrite(png.data(), 1, png.size(), fp) == png.size();
+    return fclose(fp) == 0 && result;
+}
+
+bool WritePNG(const char* filename, const u8* rgba, int width, int height, int stride, PngSpeed speed, ThreadPool* pool)
+{
+    std::vector<u8> png;
+    return EncodePNG(rgba, width, height, stride, speed, pool, &png) && WritePNGFile(filename, png);
+}
+
+bool WriteIndexedPNG(const char* filename, const u8* indices, int width, int height, int stride, const u32* palette, int palette_size, PngSpeed speed, ThreadPool* pool)
+{
+    std::vector<u8> png;
+    return EncodeIndexedPNG(indices, width, height, stride, palette, palette_size, speed, pool, &png) && WritePNGFile(filename, png);
+}
+
+PngStreamWriter::~PngStreamWriter()
+{
+    if (m_fp)
+        fclose(m_fp);
+}
+
+bool PngStreamWriter::Open(const char* filename, int width, int height, PngSpeed speed)
+{
+    if (width <= 0 || height <= 0)
+        return false;
+
+    m_chunk.clear();
+    BeginPNG(&m_chunk, width, height, 8, 6);  // RGBA
+    m_bitDepth = 8;
+    return Begin(filename, width, height, width * 4, 4, speed == PngSpeed::Fast ? FAST_FILTER : -1, speed);
+}
+
+bool PngStreamWriter::OpenIndexed(const char* filename, int width, int height, const u32* palette, int palette_size, PngSpeed speed)
+{
+    if (width <= 0 || height <= 0 || (palette_size != 16 && palette_size != 256))
+        return false;
+
+    // Same layout and filtering as PngEncoder::EncodeIndexed
+    m_bitDepth = palette_size == 16 ? 4 : 8;
+    m_chunk.clear();
+    BeginPNG(&m_chunk, width, height, m_bitDepth, 3);  // palette
+    PutPalette(&m_chunk, palette, palette_size);
+    return Begin(filename, width, height, (width * m_bitDepth + 7) / 8, 1, speed == PngSpeed::Fast ? FAST_FILTER : 0, speed);
+}
+
+// Set up for the image and write the header chunks already in m_chunk
+bool PngStreamWriter::Begin(const char* filename, int width, int height, int row_bytes, int pixel_bytes, int filter, PngSpeed speed)
+{
+    if (m_fp)
+        fclose(m_fp);
+
+    m_width = width;
+    m_height = height;
+    m_rowsWritten = 0;
+    m_rowBytes = row_bytes;
+    m_pixelBytes = pixel_bytes;
+    m_filter = filter;
+    m_speed = speed == PngSpeed::Max ? PngSpeed::Balanced : speed;
+    m_adler = 1;
+    m_first = true;
+    m_bytesWritten = 0;
+
+    // Strips as in PngEncoder::EncodeIDAT, so both write the same chunks.
+    // Reserved up front, so rows are filtered in place without reallocating.
+    const size_t filt_stride = static_cast<size_t>(row_bytes) + 1;
+    m_stripRows = STRIP_BYTES / filt_stride > 0 ? STRIP_BYTES / filt_stride : 1;
+    m_filtered.clear();
+    m_filtered.reserve(WINDOW_BYTES + m_stripRows * filt_stride);
+    m_stripStart = 0;
+    m_prevRow.assign(row_bytes, 0);
+    m_packed.resize(row_bytes);
+    m_scratch.resize(row_bytes);
+
+    m_fp = CreateOutputFile(filename);
+    m_ok = m_fp != nullptr && WriteChunks(m_chunk);
+    return m_ok;
+}
+
+bool PngStreamWriter::WriteChunks(const std::vector<u8>& data)
+{
+    if (fwrite(data.data(), 1, data.size(), m_fp) != data.size())
+        return false;
+
+    m_bytesWritten += data.size();
+    return true;
+}
+
+bool PngStreamWriter::WriteRows(const u8* rows, int count, size_t stride)
+{
+    if (!m_ok || count > m_height - m_rowsWritten)
+        return m_ok = false;
+
+    const size_t filt_stride = static_cast<size_t>(m_rowBytes) + 1;
+    for (int i = 0; i < count; i++)
+    {
+        const u8* row = rows + i * stride;
+        if (m_bitDepth == 4)
+        {
+            // High nibble first
+            memset(m_packed.data(), 0, m_rowBytes);
+            for (int x = 0; x < m_width; x++)
+                m_packed[x >> 1] |= (row[x] & 0xF) << ((x & 1) ? 0 : 4);
+            row = m_packed.data();
+        }
+
+        const size_t offset = m_filtered.size();
+        m_filtered.resize(offset + filt_stride);
+        u8* dst = m_filtered.data() + offset;
+        if (m_filter >= 0)
+        {
+            dst[0] = static_cast<u8>(m_filter);
+            FilterRow(row, m_prevRow.data(), m_rowBytes, m_pixelBytes, m_filter, dst + 1);
+        }
+        else
+        {
+            EncodeRow(row, m_prevRow.data(), m_rowBytes, m_pixelBytes, dst, m_scratch.data());
+        }
+        memcpy(m_prevRow.data(), row, m_rowBytes);
+        m_rowsWritten++;
+
+        if (m_filtered.size() - m_stripStart == m_stripRows * filt_stride && !FlushStrip())
+            return false;
+    }
+    return true;
+}
+
+// Deflate the filtered rows since the last flush into one IDAT chunk
+bool PngStreamWriter::FlushStrip()
+{
+    const size_t end = m_filtered.size();
+    if (end == m_stripStart)
+        return m_ok;
+
+    m_chunk.clear();
+    size_t offset = BeginChunk(&m_chunk, "IDAT");
+    if (m_first)
+    {
+        // zlib header: DEFLATE 32K window, FLEVEL = 1
+        m_chunk.push_back(0x78);
+        m_chunk.push_back(0x5E);
+        m_first = false;
+    }
+    if (m_speed == PngSpeed::Fast)
+        DeflateCompressChunkRLE(m_filtered.data(), m_stripStart, end, m_pixelBytes, &m_chunk);
+    else
+        DeflateCompressChunk(m_filtered.data(), m_stripStart, end, COMPRESSION_LEVEL, &m_chunk);
+    EndChunk(&m_chunk, offset);
+    m_adler = Adler32(m_filtered.data() + m_stripStart, end - m_stripStart, m_adler);
+
+    // Only the match window is needed for the next strip
+    const size_t window = end < WINDOW_BYTES ? end : WINDOW_BYTES;
+    memmove(m_filtered.data(), m_filtered.data() + end - window, window);
+    m_filtered.resize(window);
+    m_stripStart = window;
+
+    return m_ok = m_ok && WriteChunks(m_chunk);
+}
+
+bool PngStreamWriter::Close()
+{
+    if (!m_fp)
+        return false;
+
+    bool ok = m_ok && m_rowsWritten == m_height && FlushStrip();
+    if (ok)
+    {
+        m_chunk.clear();
+        size_t offset = BeginChunk(&m_chunk, "IDAT");
+        DeflateFinish(&m_chunk);
+        PutU32BE(&m_chunk, m_adler);
+        EndChunk(&m_chunk, offset);
+        EndPNG(&m_chunk);
+        ok = WriteChunks(m_chunk);
+    }
+
+    ok = fclose(m_fp) == 0 && ok;
+    m_fp = nullptr;
+    m_ok = false;
+    return ok;
+}
@@ -0,0 +1,151 @@
+// Per-frame conversion of a replayed dump implementation
+#include "replay.h"
+#include "dumpstream.h"
+#include "gsreplay.h"
+#include "threadpool.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sys/stat.h>
+
+bool ParseFrameList(const char* text, std::vector<FrameRange>* ranges)
+{
+    ranges->clear();
+    const char* p = text;
+    for (;;)
+    {
+        char* end;
+        long first = strtol(p, &end, 10);
+        if (end == p || first < 0)
+            return false;
+
+        long last = first;
+        if (*end == '-')
+        {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+            if (end == p || last < first)
+                return false;
+        }
+
+        ranges->push_back({ static_cast<int>(first), static_cast<int>(last) });
+        if (*end == '\0')
+            return true;
+        if (*end != ',')
+            return false;
+        p = end + 1;
+    }
+}
+
+static bool IsFrameSelected(const std::vector<FrameRange>& frames, int frame)
+{
+    if (frames.empty())
+        return frame > 0;
+
+    for (const FrameRange& range : frames)
+    {
+        if (frame >= range.first && frame <= range.last)
+            return true;
+    }
+    return false;
+}
+
+static int GetLastFrame(const std::vector<FrameRange>& frames)
+{
+    int last = frames.empty() ? -1 : 0;
+    for (const FrameRange& range : frames)
+    {
+        if (range.last > last)
+            last = range.last;
+    }
+    return last;
+}
+
+// <output_dir>/<input file name without .gs, .gs.xz or .gs.zst>_<frame>.png (or the extension of format)
+static std::string GetFramePath(const char* output_dir, const char* input, int frame, ImageFormat format)
+{
+    const char* slash = strrchr(input, '/');
+    std::string name = slash ? slash + 1 : input;
+    name.resize(name.size() - GetDumpExtensionLength(name.c_str()));
+
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), "_%05d%s", frame, GetImageFormatExtension(format));
+    return std::string(output_dir) + "/" + name + suffix;
+}
+
+int RunReplay(const char* input, const char* output_dir, const ConvertOptions& options, const std::vector<FrameRange>& frames, int thread_count, StatsReport& stats)
+{
+    const double start_time = GetStatsTime();
+
+    // Replay time and dump bytes not yet charged to a written frame
+    double replay_seconds = 0.0;
+    u64 charged_bytes = 0;
+
+    GSReplayer replayer;
+    bool opened;
+    {
+        ScopedTimer timer(&replay_seconds);
+        opened = replayer.Open(input);
+    }
+    if (!opened)
+        return -1;
+
+    if (mkdir(output_dir, 0777) != 0 && errno != EEXIST)
+        return -1;
+
+    ThreadPool pool(thread_count);
+    Converter converter;
+    const int last_frame = GetLastFrame(frames);
+    int written = 0;
+    int failures = 0;
+
+    // Frame 0 is the state before any packet; later frames end at a vsync
+    bool have_frame = true;
+    while (have_frame)
+    {
+        const int frame = replayer.GetFrame();
+        if (IsFrameSelected(frames, frame))
+        {
+            std::string output = GetFramePath(output_dir, input, frame, options.format);
+            converter.ResetStats();
+            converter.Deswizzle(replayer.GetVRAM(), options, &pool);
+            const bool ok = converter.Write(output.c_str(), options, &pool);
+            if (ok)
+            {
+                printf("[%d] %s\n", frame, output.c_str());
+                written++;
+            }
+            else
+            {
+                fprintf(stderr, "Error: Failed to write output file: %s\n", output.c_str());
+                failures++;
+            }
+
+            ConvertStats frame_stats = converter.GetStats();
+            frame_stats.load_seconds = replay_seconds;
+            frame_stats.bytes_read = replayer.GetBytesRead() - charged_bytes;
+            stats.AddFile(input, output.c_str(), frame, ok, frame_stats);
+            replay_seconds = 0.0;
+            charged_bytes = replayer.GetBytesRead();
+        }
+
+        if (last_frame >= 0 && frame >= last_frame)
+            break;
+
+        ScopedTimer timer(&replay_seconds);
+        have_frame = replayer.NextFrame();
+    }
+
+    if (replayer.HasError())
+    {
+        fprintf(stderr, "Error: Malformed packet after frame %d in %s\n", replayer.GetFrame(), input);
+        failures++;
+    }
+
+    printf("Wrote %d frames (%d vsyncs replayed)\n", written, replayer.GetFrame());
+    stats.Finish(GetStatsTime() - start_time);
+    return failures;
+}
@@ -0,0 +1,163 @@
+// Per-stage timings and counters implementation
+#include "stats.h"
+
+#include <chrono>
+
+void ConvertStats::Add(const ConvertStats& other)
+{
+    load_seconds += other.load_seconds;
+    deswizzle_seconds += other.deswizzle_seconds;
+    encode_seconds += other.encode_seconds;
+    write_seconds += other.write_seconds;
+    bytes_read += other.bytes_read;
+    pixels += other.pixels;
+    png_bytes += other.png_bytes;
+    cache_hits += other.cache_hits;
+}
+
+double GetStatsTime()
+{
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Quoted JSON string; paths are the only free-form text we emit
+static std::string JsonString(const char* text)
+{
+    std::string result = "\"";
+    for (const char* p = text; *p; p++)
+    {
+        const unsigned char c = static_cast<unsigned char>(*p);
+        if (c == '"' || c == '\\')
+        {
+            result += '\\';
+            result += *p;
+        }
+        else if (c < 0x20)
+        {
+            char escape[8];
+            snprintf(escape, sizeof(escape), "\\u%04x", c);
+            result += escape;
+        }
+        else
+        {
+            result += *p;
+        }
+    }
+    return result + "\"";
+}
+
+static double Rate(double amount, double seconds)
+{
+    return seconds > 0.0 ? amount / seconds : 0.0;
+}
+
+static void PrintStages(FILE* fp, const ConvertStats& stats)
+{
+    fprintf(fp, "  load      %10.3f ms  %llu bytes read (%.1f MB/s)\n", stats.load_seconds * 1e3,
+        static_cast<unsigned long long>(stats.bytes_read), Rate(stats.bytes_read / (1024.0 * 1024.0), stats.load_seconds));
+    fprintf(fp, "  deswizzle %10.3f ms  %llu pixels (%.2f ns/pixel)\n", stats.deswizzle_seconds * 1e3,
+        static_cast<unsigned long long>(stats.pixels), stats.pixels ? stats.deswizzle_seconds * 1e9 / stats.pixels : 0.0);
+    fprintf(fp, "  encode    %10.3f ms  %llu bytes compressed (%.1f Mpixel/s)\n", stats.encode_seconds * 1e3,
+        static_cast<unsigned long long>(stats.png_bytes), Rate(stats.pixels / 1e6, stats.encode_seconds));
+    fprintf(fp, "  write     %10.3f ms\n", stats.write_seconds * 1e3);
+    if (stats.cache_hits)
+        fprintf(fp, "  cache     %10llu hits\n", static_cast<unsigned long long>(stats.cache_hits));
+    fprintf(fp, "  total     %10.3f ms\n", stats.GetTotalSeconds() * 1e3);
+}
+
+static void PrintJsonStages(FILE* fp, const ConvertStats& stats)
+{
+    fprintf(fp, "\"load_ms\":%.3f,\"deswizzle_ms\":%.3f,\"encode_ms\":%.3f,\"write_ms\":%.3f,\"total_ms\":%.3f,"
+        "\"bytes_read\":%llu,\"pixels\":%llu,\"png_bytes\":%llu,\"cache_hits\":%llu",
+        stats.load_seconds * 1e3, stats.deswizzle_seconds * 1e3, stats.encode_seconds * 1e3, stats.write_seconds * 1e3,
+        stats.GetTotalSeconds() * 1e3, static_cast<unsigned long long>(stats.bytes_read),
+        static_cast<unsigned long long>(stats.pixels), static_cast<unsigned long long>(stats.png_bytes),
+        static_cast<unsigned long long>(stats.cache_hits));
+}
+
+StatsReport::StatsReport()
+    : m_format(StatsFormat::None)
+    , m_fp(nullptr)
+    , m_ownsFile(false)
+    , m_files(0)
+    , m_failed(0)
+{
+}
+
+StatsReport::~StatsReport()
+{
+    if (m_ownsFile)
+        fclose(m_fp);
+}
+
+bool StatsReport::Open(StatsFormat format, const char* filename)
+{
+    m_format = format;
+    if (format == StatsFormat::None)
+        return true;
+
+    if (!filename)
+    {
+        m_fp = stderr;
+        return true;
+    }
+
+    m_fp = fopen(filename, "w");
+    m_ownsFile = m_fp != nullptr;
+    if (!m_fp)
+        m_format = StatsFormat::None;
+    return m_fp != nullptr;
+}
+
+void StatsReport::AddFile(const char* input, const char* output, int frame, bool ok, const ConvertStats& stats)
+{
+    if (m_format == StatsFormat::None)
+        return;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_total.Add(stats);
+    m_files++;
+    if (!ok)
+        m_failed++;
+
+    if (m_format == StatsFormat::Json)
+    {
+        fprintf(m_fp, "{\"input\":%s,\"output\":%s,", JsonString(input).c_str(), JsonString(output).c_str());
+        if (frame >= 0)
+            fprintf(m_fp, "\"frame\":%d,", frame);
+        fprintf(m_fp, "\"ok\":%s,", ok ? "true" : "false");
+        PrintJsonStages(m_fp, stats);
+        fprintf(m_fp, "}\n");
+    }
+    else
+    {
+        if (frame >= 0)
+            fprintf(m_fp, "%s [%d] -> %s%s\n", input, frame, output, ok ? "" : " (failed)");
+        else
+            fprintf(m_fp, "%s -> %s%s\n", input, output, ok ? "" : " (failed)");
+        PrintStages(m_fp, stats);
+    }
+    fflush(m_fp);
+}
+
+void StatsReport::Finish(double wall_seconds)
+{
+    if (m_format == StatsFormat::None)
+        return;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_format == StatsFormat::Json)
+    {
+        fprintf(m_fp, "{\"total\":true,\"files\":%d,\"failed\":%d,\"wall_ms\":%.3f,", m_files, m_failed, wall_seconds * 1e3);
+        PrintJsonStages(m_fp, m_total);
+        fprintf(m_fp, "}\n");
+    }
+    else
+    {
+        // Stage times are summed over threads, so they can exceed the wall time
+        fprintf(m_fp, "Total: %d files, %d failed, %.3f ms wall\n", m_files, m_failed, wall_seconds * 1e3);
+        PrintStages(m_fp, m_total);
+    }
+    fflush(m_fp);
+}
@@ -0,0 +1,238 @@
+// Width sweep implementation
+#include "sweep.h"
+#include "dumpstream.h"
+#include "gsswizzle.h"
+#include "threadpool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <vector>
+
+// Contact sheet layout: square cells with a gap around each, in rows of SHEET_COLUMNS
+static const int SHEET_CELL = 256;
+static const int SHEET_GAP = 4;
+static const int SHEET_COLUMNS = 8;
+static const u32 SHEET_BACKGROUND = 0xFF202020;
+
+bool ParseWidthRange(const char* text, WidthRange* range)
+{
+    char* end;
+    long first = strtol(text, &end, 10);
+    if (end == text || first <= 0 || first > 16384)
+        return false;
+
+    long last = first;
+    if (strncmp(end, "..", 2) == 0)
+    {
+        const char* p = end + 2;
+        last = strtol(p, &end, 10);
+        if (end == p || last < first || last > 16384)
+            return false;
+    }
+
+    if (*end != '\0')
+        return false;
+
+    range->first = static_cast<int>(first);
+    range->last = static_cast<int>(last);
+    return true;
+}
+
+// <output_dir>/<input file name without .gs, .gs.xz or .gs.zst><suffix>
+static std::string GetSweepPath(const char* output_dir, const char* input, const char* suffix)
+{
+    const char* slash = strrchr(input, '/');
+    std::string name = slash ? slash + 1 : input;
+    name.resize(name.size() - GetDumpExtensionLength(name.c_str()));
+    return std::string(output_dir) + "/" + name + suffix;
+}
+
+// Box-filter the top-left corner of the last deswizzled image into a sheet
+// cell: scaled down by the smallest whole factor that fits the cell width, so
+// rows stay rows, and cropped to the cell height
+static void DrawThumbnail(const Converter& converter, u8* cell, size_t sheet_stride)
+{
+    const int width = converter.GetWidth();
+    const int scale = (width + SHEET_CELL - 1) / SHEET_CELL;
+    const int thumb_width = width / scale;
+    const int thumb_height = std::min(converter.GetHeight() / scale, SHEET_CELL);
+    const u8* image = converter.GetImage();
+    const u32* palette = converter.GetPaletteSize() ? converter.GetPalette() : nullptr;
+
+    for (int ty = 0; ty < thumb_height; ty++)
+    {
+        u8* out = cell + ty * sheet_stride;
+        for (int tx = 0; tx < thumb_width; tx++)
+        {
+            u32 sum[4] = {};
+            for (int sy = 0; sy < scale; sy++)
+            {
+                const size_t row = static_cast<size_t>(ty * scale + sy) * width;
+                for (int sx = 0; sx < scale; sx++)
+                {
+                    const size_t index = row + tx * scale + sx;
+                    u8 color[4];
+                    if (palette)
+                        memcpy(color, &palette[image[index]], 4);
+                    else
+                        memcpy(color, image + index * 4, 4);
+
+                    for (int c = 0; c < 4; c++)
+                        sum[c] += color[c];
+                }
+            }
+
+            for (int c = 0; c < 4; c++)
+                out[tx * 4 + c] = static_cast<u8>(sum[c] / (scale * scale));
+        }
+    }
+}
+
+struct SweepContext
+{
+    const char* input;
+    const char* output_dir;
+    const u8* vram;
+    const ConvertOptions* options;
+    std::vector<int> widths;
+    ConvertStats load_stats;    // Charged to the first width
+    StatsReport* stats;
+    u8* sheet = nullptr;
+    int sheet_columns = 0;
+    size_t sheet_stride = 0;
+    std::atomic<int> next;
+    std::atomic<int> written;
+    std::atomic<int> failures;
+
+    SweepContext()
+        : next(0)
+        , written(0)
+        , failures(0)
+    {
+    }
+};
+
+static void SweepWorker(SweepContext& context)
+{
+    Converter converter;
+
+    int i;
+    while ((i = context.next++) < static_cast<int>(context.widths.size()))
+    {
+        ConvertOptions options = *context.options;
+        options.vram_width = context.widths[i];
+
+        char suffix[32];
+        snprintf(suffix, sizeof(suffix), "_w%04d%s", options.vram_width, GetImageFormatExtension(options.format));
+        const std::string output = GetSweepPath(context.output_dir, context.input, suffix);
+
+        converter.ResetStats();
+        converter.Deswizzle(context.vram, options);
+        const bool ok = converter.Write(output.c_str(), options);
+        if (ok)
+        {
+            printf("[%d] %s\n", options.vram_width, output.c_str());
+            context.written++;
+        }
+        else
+        {
+            fprintf(stderr, "Error: Failed to write output file: %s\n", output.c_str());
+            context.failures++;
+        }
+
+        // Cells do not overlap, so workers draw without locking
+        if (context.sheet)
+        {
+            const int column = i % context.sheet_columns;
+            const int row = i / context.sheet_columns;
+            u8* cell = context.sheet + (SHEET_GAP + row * (SHEET_CELL + SHEET_GAP)) * context.sheet_stride +
+                (SHEET_GAP + column * (SHEET_CELL + SHEET_GAP)) * 4;
+            DrawThumbnail(converter, cell, context.sheet_stride);
+        }
+
+        ConvertStats width_stats = converter.GetStats();
+        if (i == 0)
+        {
+            width_stats.load_seconds = context.load_stats.load_seconds;
+            width_stats.bytes_read = context.load_stats.bytes_read;
+        }
+        context.stats->AddFile(context.input, output.c_str(), -1, ok, width_stats);
+    }
+}
+
+int RunWidthSweep(const char* input, const char* output_dir, const ConvertOptions& options, const WidthRange& widths, bool contact_sheet, int thread_count, StatsReport& stats)
+{
+    const double start_time = GetStatsTime();
+
+    Converter loader;
+    if (!loader.Load(input, options))
+        return -1;
+
+    if (mkdir(output_dir, 0777) != 0 && errno != EEXIST)
+        return -1;
+
+    SweepContext context;
+    context.input = input;
+    context.output_dir = output_dir;
+    context.vram = loader.GetDump().GetVRAM();
+    context.options = &options;
+    context.load_stats = loader.GetStats();
+    context.stats = &stats;
+
+    const int step = GetPsmPageWidth(options.psm);
+    for (int width = (widths.first + step - 1) / step * step; width <= widths.last; width += step)
+        context.widths.push_back(width);
+
+    const int count = static_cast<int>(context.widths.size());
+    std::vector<u32> sheet;
+    int sheet_width = 0;
+    int sheet_height = 0;
+    if (contact_sheet && count > 0)
+    {
+        context.sheet_columns = std::min(count, SHEET_COLUMNS);
+        const int sheet_rows = (count + context.sheet_columns - 1) / context.sheet_columns;
+        sheet_width = SHEET_GAP + context.sheet_columns * (SHEET_CELL + SHEET_GAP);
+        sheet_height = SHEET_GAP + sheet_rows * (SHEET_CELL + SHEET_GAP);
+        sheet.assign(static_cast<size_t>(sheet_width) * sheet_height, SHEET_BACKGROUND);
+        context.sheet = reinterpret_cast<u8*>(sheet.data());
+        context.sheet_stride = static_cast<size_t>(sheet_width) * 4;
+    }
+
+    if (thread_count <= 0)
+        thread_count = ThreadPool::GetHardwareThreadCount();
+
+    // Widths are independent, so each worker takes whole images
+    std::vector<std::thread> workers;
+    for (int i = 0; i < std::min(thread_count, count); i++)
+        workers.emplace_back(SweepWorker, std::ref(context));
+    for (std::thread& worker : workers)
+        worker.join();
+
+    int failures = context.failures.load();
+    if (context.sheet)
+    {
+        const std::string sheet_path = GetSweepPath(output_dir, input, "_sheet.png");
+        ThreadPool pool(thread_count);
+        if (WritePNG(sheet_path.c_str(), context.sheet, sheet_width, sheet_height, sheet_width * 4, options.png_speed, &pool))
+        {
+            printf("Contact sheet: %s (%d widths per row, %d to %d in steps of %d)\n", sheet_path.c_str(),
+                context.sheet_columns, context.widths.front(), context.widths.back(), step);
+        }
+        else
+        {
+            fprintf(stderr, "Error: Failed to write PNG file: %s\n", sheet_path.c_str());
+            failures++;
+        }
+    }
+
+    printf("Wrote %d of %d widths\n", context.written.load(), count);
+    stats.Finish(GetStatsTime() - start_time);
+    return failures;
+}
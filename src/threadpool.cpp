@@ -0,0 +1,128 @@
+// Fixed-size worker thread pool implementation
+#include "threadpool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+ThreadPool::ThreadPool(int threads)
+    : m_threadCount(threads > 0 ? threads : GetHardwareThreadCount())
+    , m_stop(false)
+{
+    if (m_threadCount > 1)
+    {
+        m_workers.reserve(m_threadCount);
+        for (int i = 0; i < m_threadCount; i++)
+            m_workers.emplace_back(&ThreadPool::WorkerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_taskReady.notify_all();
+
+    for (std::thread& worker : m_workers)
+        worker.join();
+}
+
+int ThreadPool::GetHardwareThreadCount()
+{
+    unsigned int count = std::thread::hardware_concurrency();
+    return count > 0 ? static_cast<int>(count) : 1;
+}
+
+void ThreadPool::Submit(std::function<void()> task)
+{
+    if (m_workers.empty())
+    {
+        task();
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tasks.push(std::move(task));
+    }
+    m_taskReady.notify_one();
+}
+
+void ThreadPool::ParallelFor(int count, const std::function<void(int)>& func)
+{
+    if (count <= 0)
+        return;
+
+    if (m_workers.empty() || count == 1)
+    {
+        for (int i = 0; i < count; i++)
+            func(i);
+        return;
+    }
+
+    // Helpers pull indices from a shared counter; the caller drains it too, so
+    // the loop completes even if every worker is busy elsewhere. Once it has,
+    // helpers that have not started yet are closed out rather than waited for:
+    // with every worker inside a ParallelFor of its own they never would.
+    struct Shared
+    {
+        std::atomic<int> next{0};
+        int running = 0;
+        bool closed = false;
+        std::mutex mutex;
+        std::condition_variable done;
+    };
+    auto shared = std::make_shared<Shared>();
+
+    auto drain = [shared, count, &func]()
+    {
+        for (int i = shared->next++; i < count; i = shared->next++)
+            func(i);
+    };
+
+    const int helpers = std::min(count, m_threadCount) - 1;
+    for (int h = 0; h < helpers; h++)
+    {
+        Submit([shared, drain]()
+        {
+            {
+                std::lock_guard<std::mutex> lock(shared->mutex);
+                if (shared->closed)
+                    return;
+                shared->running++;
+            }
+
+            drain();
+            std::lock_guard<std::mutex> lock(shared->mutex);
+            if (--shared->running == 0)
+                shared->done.notify_one();
+        });
+    }
+
+    drain();
+
+    std::unique_lock<std::mutex> lock(shared->mutex);
+    shared->closed = true;
+    shared->done.wait(lock, [&shared] { return shared->running == 0; });
+}
+
+void ThreadPool::WorkerLoop()
+{
+    for (;;)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_taskReady.wait(lock, [this] { return m_stop || !m_tasks.empty(); });
+            if (m_stop && m_tasks.empty())
+                return;
+
+            task = std::move(m_tasks.front());
+            m_tasks.pop();
+        }
+
+        task();
+    }
+}
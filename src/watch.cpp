@@ -0,0 +1,397 @@
+// Watch-folder conversion implementation
+#include "watch.h"
+#include "batch.h"
+#include "dumpstream.h"
+#include "hash.h"
+#include "threadpool.h"
+
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <poll.h>
+#include <set>
+#include <string>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+static const char* INDEX_NAME = ".gs2png-index";
+
+static volatile sig_atomic_t g_stopWatching = 0;
+
+static void OnStopSignal(int)
+{
+    g_stopWatching = 1;
+}
+
+// What a dump looked like when it was last converted
+struct IndexEntry
+{
+    u64 size = 0;
+    s64 mtime = 0;  // Nanoseconds since the epoch
+    u64 hash = 0;   // Hash64 of the file contents
+};
+
+// On-disk record of finished conversions: a header naming the options hash,
+// then one "<size> <mtime> <hash> <name>" line per conversion. Lines are
+// appended as work finishes and later lines win; Open rewrites it compacted.
+class WatchIndex
+{
+public:
+    ~WatchIndex()
+    {
+        if (m_fp)
+            fclose(m_fp);
+    }
+
+    bool Open(const std::string& path, u64 options_hash)
+    {
+        Load(path, options_hash);
+
+        // Rewrite through a temporary file so a crash never loses the old index
+        const std::string temp_path = path + ".tmp";
+        FILE* fp = fopen(temp_path.c_str(), "w");
+        if (!fp)
+            return false;
+
+        fprintf(fp, "# gs2png watch index, options %016llx\n", static_cast<unsigned long long>(options_hash));
+        for (const auto& item : m_entries)
+            WriteEntry(fp, item.first, item.second);
+
+        if (fclose(fp) != 0 || rename(temp_path.c_str(), path.c_str()) != 0)
+            return false;
+
+        m_fp = fopen(path.c_str(), "a");
+        return m_fp != nullptr;
+    }
+
+    bool Find(const std::string& name, IndexEntry* entry)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_entries.find(name);
+        if (it == m_entries.end())
+            return false;
+        *entry = it->second;
+        return true;
+    }
+
+    void Record(const std::string& name, const IndexEntry& entry)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_entries[name] = entry;
+        WriteEntry(m_fp, name, entry);
+        fflush(m_fp);
+    }
+
+private:
+    // Entries written under other options are dropped
+    void Load(const std::string& path, u64 options_hash)
+    {
+        FILE* fp = fopen(path.c_str(), "r");
+        if (!fp)
+            return;
+
+        char* line = nullptr;
+        size_t capacity = 0;
+        unsigned long long header_hash = 0;
+        if (getline(&line, &capacity, fp) != -1 &&
+            sscanf(line, "# gs2png watch index, options %llx", &header_hash) == 1 && header_hash == options_hash)
+        {
+            while (getline(&line, &capacity, fp) != -1)
+            {
+                unsigned long long size, hash;
+                long long mtime;
+                int name_start = 0;
+                if (sscanf(line, "%llu %lld %llx %n", &size, &mtime, &hash, &name_start) != 3 || name_start == 0)
+                    continue;
+
+                std::string name = line + name_start;
+                while (!name.empty() && (name.back() == '\n' || name.back() == '\r'))
+                    name.pop_back();
+                if (name.empty())
+                    continue;
+
+                IndexEntry& entry = m_entries[name];
+                entry.size = size;
+                entry.mtime = mtime;
+                entry.hash = hash;
+            }
+        }
+
+        free(line);
+        fclose(fp);
+    }
+
+    static void WriteEntry(FILE* fp, const std::string& name, const IndexEntry& entry)
+    {
+        fprintf(fp, "%llu %lld %016llx %s\n", static_cast<unsigned long long>(entry.size), static_cast<long long>(entry.mtime),
+            static_cast<unsigned long long>(entry.hash), name.c_str());
+    }
+
+    std::mutex m_mutex;
+    std::map<std::string, IndexEntry> m_entries;
+    FILE* m_fp = nullptr;
+};
+
+struct WatchContext
+{
+    std::string watch_dir;
+    std::string output_dir;
+    const ConvertOptions* options;
+    StatsReport* stats;
+    WatchIndex index;
+    BoundedQueue<std::string> queue;
+    std::mutex pending_mutex;
+    std::set<std::string> pending;  // Queued or being converted; a burst of events queues a dump once
+    std::set<std::string> dirty;    // Changed again while being converted
+    std::atomic<int> converted;
+    std::atomic<int> failures;
+
+    explicit WatchContext(size_t queue_capacity)
+        : queue(queue_capacity)
+        , converted(0)
+        , failures(0)
+    {
+    }
+
+    void Enqueue(const std::string& name)
+    {
+        {
+            std::lock_guard<std::mutex> lock(pending_mutex);
+            if (!pending.insert(name).second)
+            {
+                dirty.insert(name);
+                return;
+            }
+        }
+        queue.Push(name);
+    }
+
+    // True if the dump changed while it was being converted, so the same
+    // worker looks at it again; two workers never write one output
+    bool Finish(const std::string& name)
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex);
+        if (dirty.erase(name))
+            return true;
+        pending.erase(name);
+        return false;
+    }
+};
+
+static bool FileExists(const std::string& path)
+{
+    return access(path.c_str(), F_OK) == 0;
+}
+
+static void ConvertIfChanged(WatchContext& context, Converter& converter, const std::string& name)
+{
+    const std::string input = context.watch_dir + "/" + name;
+    const std::string output = GetOutputPath(context.output_dir.c_str(), input, context.options->format);
+
+    // Gone or replaced by something else since the event
+    struct stat st;
+    if (stat(input.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+        return;
+
+    // Same rule as batch mode: the name that sorts first keeps the output
+    const std::string sibling = FindEarlierSiblingDump(context.watch_dir, name);
+    if (!sibling.empty())
+    {
+        fprintf(stderr, "Error: %s would overwrite %s from %s; skipped\n", input.c_str(), output.c_str(),
+            (context.watch_dir + "/" + sibling).c_str());
+        context.failures++;
+        return;
+    }
+
+    IndexEntry entry;
+    entry.size = static_cast<u64>(st.st_size);
+    entry.mtime = static_cast<s64>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+
+    // Size and mtime unchanged: done without reading the file
+    IndexEntry previous;
+    const bool known = context.index.Find(name, &previous) && FileExists(output);
+    if (known && previous.size == entry.size && previous.mtime == entry.mtime)
+        return;
+
+    if (!HashFile(input.c_str(), &entry.hash))
+    {
+        fprintf(stderr, "Error: Failed to read GS dump file: %s\n", input.c_str());
+        context.failures++;
+        return;
+    }
+
+    // Touched or copied over with the same contents
+    if (known && previous.hash == entry.hash)
+    {
+        context.index.Record(name, entry);
+        return;
+    }
+
+    if (!ConvertDump(converter, input, output, *context.options, *context.stats))
+    {
+        context.failures++;
+        return;
+    }
+
+    context.index.Record(name, entry);
+
+    printf("%s -> %s\n", input.c_str(), output.c_str());
+    fflush(stdout);
+    context.converted++;
+}
+
+static void WatchWorker(WatchContext& context, int worker_index)
+{
+    // Same per-worker setup as batch mode
+    if (context.options->numa_local)
+        BindThreadToNumaNode(worker_index % GetNumaNodeCount());
+    Converter converter;
+
+    // Keep popping until the queue is closed, even once stopping: the main
+    // thread may be blocked pushing into a full queue and must get to Close
+    std::string name;
+    while (context.queue.Pop(&name))
+    {
+        if (g_stopWatching)
+            continue;
+
+        do
+            ConvertIfChanged(context, converter, name);
+        while (!g_stopWatching && context.Finish(name));
+    }
+}
+
+static bool ScanDirectory(WatchContext& context)
+{
+    std::vector<std::string> names;
+    if (!ListDumps(context.watch_dir.c_str(), &names))
+        return false;
+
+    for (const std::string& name : names)
+    {
+        if (g_stopWatching)
+            break;
+        context.Enqueue(name);
+    }
+    return true;
+}
+
+// Queue the dumps named by the pending inotify events. Returns false once the
+// directory itself is gone.
+static bool ReadEvents(WatchContext& context, int fd)
+{
+    alignas(inotify_event) char buffer[64 * 1024];
+    bool rescan = false;
+
+    ssize_t length;
+    while ((length = read(fd, buffer, sizeof(buffer))) > 0)
+    {
+        for (char* p = buffer; p < buffer + length;)
+        {
+            const inotify_event* event = reinterpret_cast<const inotify_event*>(p);
+            p += sizeof(inotify_event) + event->len;
+
+            if (event->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF))
+                return false;
+
+            // The kernel dropped events; find what changed by looking again
+            if (event->mask & IN_Q_OVERFLOW)
+                rescan = true;
+            else if (event->len && !(event->mask & IN_ISDIR) && GetDumpExtensionLength(event->name) != 0)
+                context.Enqueue(event->name);
+        }
+    }
+
+    return !rescan || ScanDirectory(context);
+}
+
+int RunWatch(const char* watch_dir, const char* output_dir, const ConvertOptions& options, int thread_count, StatsReport& stats)
+{
+    if (mkdir(output_dir, 0777) != 0 && errno != EEXIST)
+        return -1;
+
+    // Only finished files: written and closed, or moved in whole
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    if (inotify_add_watch(fd, watch_dir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    if (thread_count <= 0)
+        thread_count = ThreadPool::GetHardwareThreadCount();
+
+    WatchContext context(thread_count * 2);
+    context.watch_dir = watch_dir;
+    context.output_dir = output_dir;
+    context.options = &options;
+    context.stats = &stats;
+
+    const std::string index_path = std::string(output_dir) + "/" + INDEX_NAME;
+    if (!context.index.Open(index_path, HashConvertOptions(options)))
+    {
+        fprintf(stderr, "Error: Failed to write watch index: %s\n", index_path.c_str());
+        close(fd);
+        return -1;
+    }
+
+    // No SA_RESTART, so a signal also wakes the poll below
+    struct sigaction action = {};
+    struct sigaction old_int, old_term;
+    action.sa_handler = OnStopSignal;
+    sigemptyset(&action.sa_mask);
+    g_stopWatching = 0;
+    sigaction(SIGINT, &action, &old_int);
+    sigaction(SIGTERM, &action, &old_term);
+
+    const double start_time = GetStatsTime();
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < thread_count; i++)
+        workers.emplace_back(WatchWorker, std::ref(context), i);
+
+    printf("Watching %s for new dumps (Ctrl+C to stop)\n", watch_dir);
+    fflush(stdout);
+
+    // The watch is already in place, so nothing written during the scan is missed
+    const bool scanned = ScanDirectory(context);
+    bool watching = scanned;
+
+    while (watching && !g_stopWatching)
+    {
+        pollfd poll_fd = { fd, POLLIN, 0 };
+        int ready = poll(&poll_fd, 1, 1000);
+        if (ready < 0 && errno != EINTR)
+            break;
+        if (ready > 0 && !ReadEvents(context, fd))
+        {
+            fprintf(stderr, "Error: Watched directory was removed: %s\n", watch_dir);
+            watching = false;
+        }
+    }
+
+    // Jobs still queued are dropped; they are picked up by the next run
+    g_stopWatching = 1;
+    context.queue.Close();
+    for (std::thread& worker : workers)
+        worker.join();
+
+    sigaction(SIGINT, &old_int, nullptr);
+    sigaction(SIGTERM, &old_term, nullptr);
+    close(fd);
+    if (!scanned)
+        return -1;
+
+    printf("Converted %d dumps\n", context.converted.load());
+    stats.Finish(GetStatsTime() - start_time);
+    return context.failures.load();
+}